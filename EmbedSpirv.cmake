@@ -0,0 +1,49 @@
+# Writes OUTPUT, a C++ source that embeds the SPIR-V binaries listed in
+# SPIRV_FILES ('|' separated) as uint32_t arrays, for src/embedded_shaders.h.
+#
+#   cmake -DOUTPUT=<file.cpp> -DSPIRV_FILES=<a.spv|b.spv> -P EmbedSpirv.cmake
+
+string(REPLACE "|" ";" SPIRV_FILES "${SPIRV_FILES}")
+
+# CMake regular expressions have no repetition counts
+set(EIGHT_WORDS "")
+foreach(WORD RANGE 1 8)
+    string(APPEND EIGHT_WORDS "0x........u, ")
+endforeach()
+
+set(ARRAYS "")
+set(TABLE "")
+set(INDEX 0)
+
+foreach(SPIRV ${SPIRV_FILES})
+    get_filename_component(FILE_NAME ${SPIRV} NAME)
+    string(REGEX REPLACE "\\.spv$" "" SHADER_NAME ${FILE_NAME})
+
+    file(READ ${SPIRV} HEX HEX)
+    string(LENGTH "${HEX}" HEX_LENGTH)
+    math(EXPR REMAINDER "${HEX_LENGTH} % 8")
+    string(SUBSTRING "${HEX}" 0 8 MAGIC)
+    if (NOT REMAINDER EQUAL 0 OR NOT MAGIC STREQUAL "03022307")
+        message(FATAL_ERROR "${SPIRV} is not a SPIR-V binary")
+    endif()
+
+    # SPIR-V words are little endian, eight of them per line
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u, " WORDS "${HEX}")
+    string(REGEX REPLACE "(${EIGHT_WORDS})" "\\1\n   " WORDS "${WORDS}")
+    string(REPLACE ", \n" ",\n" WORDS "${WORDS}")
+
+    string(APPEND ARRAYS "// ${FILE_NAME}\nconst uint32_t shader${INDEX}[] = {\n   ${WORDS}\n};\n\n")
+    string(APPEND TABLE "  { \"${SHADER_NAME}\", shader${INDEX}, sizeof(shader${INDEX}) },\n")
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+file(WRITE ${OUTPUT}
+    "// Generated by EmbedSpirv.cmake, do not edit.\n\n"
+    "#include \"embedded_shaders.h\"\n\n"
+    "namespace {\n\n"
+    "${ARRAYS}"
+    "} // namespace\n\n"
+    "const EmbeddedShader embeddedShaders[] = {\n"
+    "${TABLE}"
+    "  { nullptr, nullptr, 0 },\n"
+    "};\n")
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth prepass for the packed vertex formats, matching shader_quantized.vert.
+layout(binding = 0) uniform UniformBufferObject {
+  mat4 model;
+  mat4 view;
+  mat4 proj;
+} ubo;
+
+layout(push_constant) uniform Dequantization {
+  vec4 positionScale;
+  vec4 positionOffset;
+  vec4 texCoordScaleOffset;
+} dequantization;
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main() {
+  vec3 position = inPosition * dequantization.positionScale.xyz + dequantization.positionOffset.xyz;
+  gl_Position = ubo.proj * ubo.view * ubo.model * vec4(position, 1.0);
+}
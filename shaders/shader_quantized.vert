@@ -0,0 +1,35 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+  mat4 model;
+  mat4 view;
+  mat4 proj;
+} ubo;
+
+// VertexDequantization: undoes the per-mesh packing of positions and
+// texture coordinates, see vertex_quantization.h
+layout(push_constant) uniform Dequantization {
+  vec4 positionScale;
+  vec4 positionOffset;
+  vec4 texCoordScaleOffset;
+} dequantization;
+
+// snorm16 or half positions, unorm8 color, unorm16 or half texture coordinates;
+// the vertex input formats do the conversion to float
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+// must match the depth prepass exactly
+invariant gl_Position;
+
+void main() {
+  vec3 position = inPosition * dequantization.positionScale.xyz + dequantization.positionOffset.xyz;
+  gl_Position = ubo.proj * ubo.view * ubo.model * vec4(position, 1.0);
+  fragColor = inColor;
+  fragTexCoord = inTexCoord * dequantization.texCoordScaleOffset.xy + dequantization.texCoordScaleOffset.zw;
+}
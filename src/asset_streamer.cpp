@@ -0,0 +1,229 @@
+#include "asset_streamer.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+const size_t pageSize = 4096;
+
+// Touches every page of the mapping so the I/O thread, not the decoder,
+// waits for the disk. Returns something derived from the data so the reads
+// are not optimized away.
+unsigned char faultIn(const MappedFile& file) {
+  unsigned char sum = 0;
+  for (size_t offset = 0; offset < file.size(); offset += pageSize) {
+    sum ^= static_cast<unsigned char>(file.data()[offset]);
+  }
+  return sum;
+}
+
+float secondsSince(std::chrono::high_resolution_clock::time_point startTime) {
+  auto endTime = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<float, std::chrono::seconds::period>(endTime - startTime).count();
+}
+
+} // namespace
+
+AssetStreamer::AssetStreamer(unsigned int ioThreadCount, unsigned int decodeThreadCount) {
+  if (decodeThreadCount == 0) {
+    decodeThreadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // requests with a path would wait forever without one
+  ioThreadCount = std::max(1u, ioThreadCount);
+
+  for (unsigned int i = 0; i < ioThreadCount; i++) {
+    workers.emplace_back(&AssetStreamer::readWork, this);
+  }
+  for (unsigned int i = 0; i < decodeThreadCount; i++) {
+    workers.emplace_back(&AssetStreamer::decodeWork, this);
+  }
+}
+
+AssetStreamer::~AssetStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  readQueueChanged.notify_all();
+  decodeQueueChanged.notify_all();
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+AssetId AssetStreamer::request(AssetRequest request) {
+  bool read = !request.path.empty();
+  float priority = request.priority;
+
+  std::lock_guard<std::mutex> lock(queueMutex);
+  AssetId id = nextId++;
+  entries[id] = Entry{ std::move(request), read ? Stage::WaitingForRead : Stage::WaitingForDecode, MappedFile() };
+  (read ? readQueue : decodeQueue).insert({ priority, id });
+  statistics.waitingForRead = readQueue.size();
+  statistics.waitingForDecode = decodeQueue.size();
+
+  if (read) {
+    readQueueChanged.notify_one();
+  } else {
+    decodeQueueChanged.notify_one();
+  }
+  return id;
+}
+
+void AssetStreamer::setPriority(AssetId id, float priority) {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  auto entry = entries.find(id);
+  if (entry == entries.end()) {
+    return;
+  }
+
+  AssetRequest& request = entry->second.request;
+  Queue* queue = nullptr;
+  if (entry->second.stage == Stage::WaitingForRead) {
+    queue = &readQueue;
+  } else if (entry->second.stage == Stage::WaitingForDecode) {
+    queue = &decodeQueue;
+  }
+
+  if (queue) {
+    queue->erase({ request.priority, id });
+    queue->insert({ priority, id });
+  }
+  request.priority = priority;
+}
+
+size_t AssetStreamer::deliverCompleted() {
+  std::deque<AssetCompletion> ready;
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    ready.swap(completed);
+  }
+
+  for (AssetCompletion& completion : ready) {
+    completion();
+  }
+  return ready.size();
+}
+
+AssetStreamerStats AssetStreamer::stats() const {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return statistics;
+}
+
+void AssetStreamer::readWork() {
+  for (;;) {
+    AssetId id;
+    std::string path;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      readQueueChanged.wait(lock, [this]() { return stopping || !readQueue.empty(); });
+      if (stopping) {
+        return;
+      }
+      id = takeNext(readQueue, Stage::Reading);
+      path = entries[id].request.path;
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    MappedFile file;
+    std::exception_ptr error;
+    try {
+      file = MappedFile(path);
+      file.adviseSequential();
+      volatile unsigned char sink = faultIn(file);
+      (void)sink;
+    } catch (...) {
+      error = std::current_exception();
+    }
+    float seconds = secondsSince(startTime);
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    statistics.inProgress--;
+    statistics.readSeconds += seconds;
+    statistics.bytesRead += file.size();
+
+    if (error) {
+      finish(id, nullptr, error);
+      continue;
+    }
+
+    Entry& entry = entries[id];
+    entry.file = std::move(file);
+    entry.stage = Stage::WaitingForDecode;
+    decodeQueue.insert({ entry.request.priority, id });
+    statistics.waitingForDecode = decodeQueue.size();
+    decodeQueueChanged.notify_one();
+  }
+}
+
+void AssetStreamer::decodeWork() {
+  for (;;) {
+    AssetId id;
+    std::function<AssetCompletion(MappedFile)> decode;
+    MappedFile file;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      decodeQueueChanged.wait(lock, [this]() { return stopping || !decodeQueue.empty(); });
+      if (stopping) {
+        return;
+      }
+      id = takeNext(decodeQueue, Stage::Decoding);
+      decode = std::move(entries[id].request.decode);
+      file = std::move(entries[id].file);
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    AssetCompletion completion;
+    std::exception_ptr error;
+    try {
+      // unmapped outside the lock, by decode unless it keeps the file
+      completion = decode(std::move(file));
+    } catch (...) {
+      error = std::current_exception();
+    }
+    float seconds = secondsSince(startTime);
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    statistics.inProgress--;
+    statistics.decodeSeconds += seconds;
+    finish(id, std::move(completion), error);
+  }
+}
+
+AssetId AssetStreamer::takeNext(Queue& queue, Stage stage) {
+  AssetId id = queue.begin()->second;
+  queue.erase(queue.begin());
+  entries[id].stage = stage;
+
+  statistics.waitingForRead = readQueue.size();
+  statistics.waitingForDecode = decodeQueue.size();
+  statistics.inProgress++;
+  return id;
+}
+
+void AssetStreamer::finish(AssetId id, AssetCompletion completion, std::exception_ptr error) {
+  auto entry = entries.find(id);
+  std::function<void(const std::exception&)> failed = std::move(entry->second.request.failed);
+  entries.erase(entry);
+
+  if (error) {
+    completion = [error, failed]() {
+      if (!failed) {
+        std::rethrow_exception(error);
+      }
+      try {
+        std::rethrow_exception(error);
+      } catch (const std::exception& e) {
+        failed(e);
+      }
+    };
+  }
+
+  if (completion) {
+    completed.push_back(std::move(completion));
+  }
+  statistics.completed++;
+}
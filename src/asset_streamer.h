@@ -0,0 +1,121 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using AssetId = uint64_t;
+
+// What a decode step hands back: the rest of the work, which runs on the
+// thread that calls AssetStreamer::deliverCompleted. That is where data made
+// on the worker is handed to the upload path.
+using AssetCompletion = std::function<void()>;
+
+struct AssetRequest {
+  // read into memory by an I/O thread before decoding starts, so decode
+  // threads do not block on the disk; empty skips the read
+  std::string path;
+  // higher goes first, both for reading and decoding
+  float priority;
+  // runs on a decode thread once the file has been read, with its mapping,
+  // which is not open without a path; decode may keep it
+  std::function<AssetCompletion(MappedFile file)> decode;
+  // runs in deliverCompleted instead of the completion when reading or
+  // decoding threw; without it deliverCompleted rethrows
+  std::function<void(const std::exception&)> failed;
+};
+
+struct AssetStreamerStats {
+  size_t waitingForRead;
+  size_t waitingForDecode;
+  size_t inProgress; // being read or decoded right now
+  size_t completed;  // finished, failed ones included
+  uint64_t bytesRead;
+  float readSeconds;
+  float decodeSeconds;
+};
+
+// Streams assets in the background in priority order: a few I/O threads read
+// files into the page cache, decode threads turn them into GPU-ready data,
+// and the caller picks up the results whenever it is ready to upload them.
+// Priorities can change while requests wait, e.g. every frame as the camera
+// moves.
+class AssetStreamer {
+public:
+  // 0 decode threads uses every hardware thread; there is always at least
+  // one I/O thread
+  explicit AssetStreamer(unsigned int ioThreadCount = 1, unsigned int decodeThreadCount = 0);
+  // waits for the reads and decodes in progress; waiting requests and
+  // undelivered completions are dropped
+  ~AssetStreamer();
+
+  AssetStreamer(const AssetStreamer&) = delete;
+  AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+  AssetId request(AssetRequest request);
+
+  // Reorders a request that is still waiting to be read or decoded. Has no
+  // effect once it is being decoded.
+  void setPriority(AssetId id, float priority);
+
+  // Runs the completions, or failure callbacks, of the requests that
+  // finished since the last call, on the calling thread and in the order
+  // they finished. Returns how many ran.
+  size_t deliverCompleted();
+
+  AssetStreamerStats stats() const;
+
+private:
+  enum class Stage {
+    WaitingForRead,
+    Reading,
+    WaitingForDecode,
+    Decoding,
+  };
+
+  struct Entry {
+    AssetRequest request;
+    Stage stage;
+    MappedFile file; // what the I/O thread read, handed to decode
+  };
+
+  // highest priority first, then in request order
+  struct QueueOrder {
+    bool operator()(const std::pair<float, AssetId>& a, const std::pair<float, AssetId>& b) const {
+      return a.first != b.first ? a.first > b.first : a.second < b.second;
+    }
+  };
+  using Queue = std::set<std::pair<float, AssetId>, QueueOrder>;
+
+  void readWork();
+  void decodeWork();
+  // moves id from its queue to the given stage; expects queueMutex held
+  AssetId takeNext(Queue& queue, Stage stage);
+  // expects queueMutex held
+  void finish(AssetId id, AssetCompletion completion, std::exception_ptr error);
+
+  std::map<AssetId, Entry> entries; // requests not finished yet
+  Queue readQueue;
+  Queue decodeQueue;
+  std::deque<AssetCompletion> completed;
+  AssetId nextId = 1;
+  AssetStreamerStats statistics{};
+
+  std::vector<std::thread> workers;
+  mutable std::mutex queueMutex;
+  std::condition_variable readQueueChanged;
+  std::condition_variable decodeQueueChanged;
+  bool stopping = false;
+};
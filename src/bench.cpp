@@ -0,0 +1,655 @@
+// Command line benchmarks for the CPU side of the asset pipeline. These run
+// without a window or a Vulkan device:
+//
+//   vulkan-playground-bench <benchmark> [arguments...]
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <stb_image.h>
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <filesystem>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+#include <random>
+
+#include "obj_loader.h"
+#include "mesh_builder.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "index_packing.h"
+#include "vertex_quantization.h"
+#include "vertex_streams.h"
+#include "texture.h"
+#include "texture_loader.h"
+#include "texture_cache.h"
+#include "tlsf_allocator.h"
+
+const int benchmarkRuns = 3;
+
+using Clock = std::chrono::high_resolution_clock;
+
+// Runs fn benchmarkRuns times and returns the fastest run in seconds.
+double bestOf(const std::function<void()>& fn) {
+  double best = 0.0;
+  for (int i = 0; i < benchmarkRuns; i++) {
+    auto startTime = Clock::now();
+    fn();
+    auto endTime = Clock::now();
+
+    double seconds = std::chrono::duration<double, std::chrono::seconds::period>(endTime - startTime).count();
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  return best;
+}
+
+double fileMegabytes(const std::string& filename) {
+  return std::filesystem::file_size(filename) / (1024.0 * 1024.0);
+}
+
+void benchmarkObjLoader(const std::vector<std::string>& args) {
+  const std::string& filename = args.at(0);
+  double megabytes = fileMegabytes(filename);
+
+  size_t tinyobjIndices = 0;
+  double tinyobjSeconds = bestOf([&]() {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str())) {
+      throw std::runtime_error(warn + err);
+    }
+
+    tinyobjIndices = 0;
+    for (const auto& shape : shapes) {
+      tinyobjIndices += shape.mesh.indices.size();
+    }
+  });
+
+  size_t parallelIndices = 0;
+  double parallelSeconds = bestOf([&]() {
+    ObjMesh mesh = loadObjParallel(filename);
+    parallelIndices = mesh.indices.size();
+  });
+
+  std::cout << filename << ": " << megabytes << " MB" << std::endl;
+  std::cout << "  tinyobj::LoadObj  " << tinyobjSeconds * 1000.0 << " ms, "
+    << megabytes / tinyobjSeconds << " MB/s, " << tinyobjIndices / 3 << " triangles" << std::endl;
+  std::cout << "  loadObjParallel   " << parallelSeconds * 1000.0 << " ms, "
+    << megabytes / parallelSeconds << " MB/s, " << parallelIndices / 3 << " triangles" << std::endl;
+  std::cout << "  speedup           " << tinyobjSeconds / parallelSeconds << "x" << std::endl;
+}
+
+void benchmarkDedup(const std::vector<std::string>& args) {
+  ObjMesh obj = loadObjParallel(args.at(0));
+  double millionFaces = obj.indices.size() / 3 / 1000000.0;
+
+  MeshData mesh;
+  double singleSeconds = bestOf([&]() { mesh = buildMesh(obj, 1); });
+  double parallelSeconds = bestOf([&]() { mesh = buildMesh(obj); });
+
+  size_t naiveBytes = obj.indices.size() * sizeof(Vertex);
+  size_t dedupBytes = mesh.vertices.size() * sizeof(Vertex);
+
+  std::cout << args[0] << ": " << obj.shapes.size() << " shapes, "
+    << obj.indices.size() / 3 << " faces" << std::endl;
+  std::cout << "  " << obj.indices.size() << " corners -> " << mesh.vertices.size() << " vertices ("
+    << (double)obj.indices.size() / mesh.vertices.size() << "x, "
+    << naiveBytes / 1024 << " KB -> " << dedupBytes / 1024 << " KB)" << std::endl;
+  std::cout << "  1 thread          " << singleSeconds * 1000.0 / millionFaces
+    << " ms per million faces" << std::endl;
+  std::cout << "  all threads       " << parallelSeconds * 1000.0 / millionFaces
+    << " ms per million faces" << std::endl;
+}
+
+// Startup cost of getting model geometry into a staging-sized buffer, from
+// the OBJ text versus from the binary mesh cache. Both paths read through the
+// page cache, so this compares parse cost rather than disk speed. The cache
+// goes to a scratch file, leaving the app's own cache of filename alone.
+void benchmarkMeshCache(const std::vector<std::string>& args) {
+  const std::string& filename = args.at(0);
+  std::vector<char> staging;
+
+  auto stage = [&](const std::vector<std::pair<const void*, size_t>>& blobs) {
+    staging.clear();
+    for (const auto& blob : blobs) {
+      const char* bytes = static_cast<const char*>(blob.first);
+      staging.insert(staging.end(), bytes, bytes + blob.second);
+    }
+  };
+
+  // everything the app does at import, quantizing for its default format
+  PackedMesh packed;
+  UploadVertices vertices;
+  double objSeconds = bestOf([&]() {
+    packed = packIndices(buildMesh(loadObjParallel(filename)), IndexWidthPolicy::Split16);
+    vertices = prepareUploadVertices(packed.vertices.data(), packed.vertices.size(), VertexFormat::Snorm16);
+    stage({
+      { vertices.streams.positions.data(), vertices.streams.positions.size() },
+      { vertices.streams.attributes.data(), vertices.streams.attributes.size() },
+      { packed.indexData.data(), packed.indexData.size() } });
+  });
+
+  std::string cachePath = (std::filesystem::temp_directory_path() / "vulkan-playground-bench.vkmesh").string();
+  writeMeshCache(filename, cachePath, packed, vertices);
+  double cacheMegabytes = fileMegabytes(cachePath);
+
+  double cacheSeconds = bestOf([&]() {
+    auto cache = MeshCache::open(filename, MappedFile(cachePath));
+    if (!cache) {
+      throw std::runtime_error("mesh cache was not written!");
+    }
+    stage({
+      { cache->positionData(), cache->positionDataSize() },
+      { cache->attributeData(), cache->attributeDataSize() },
+      { cache->indexData(), cache->indexDataSize() } });
+  });
+  std::filesystem::remove(cachePath);
+
+  std::cout << filename << ": " << fileMegabytes(filename) << " MB obj, "
+    << cacheMegabytes << " MB cache" << std::endl;
+  std::cout << "  obj import        " << objSeconds * 1000.0 << " ms" << std::endl;
+  std::cout << "  binary cache      " << cacheSeconds * 1000.0 << " ms" << std::endl;
+  std::cout << "  speedup           " << objSeconds / cacheSeconds << "x" << std::endl;
+}
+
+void benchmarkOptimizer(const std::vector<std::string>& args) {
+  MeshData original = buildMesh(loadObjParallel(args.at(0)));
+
+  auto reportStats = [](const char* label, const MeshData& mesh) {
+    VertexCacheStats stats = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    std::cout << "  " << label << "ACMR " << stats.acmr << ", ATVR " << stats.atvr
+      << ", " << stats.acmr * mesh.indices.size() / 3 << " vertex shader invocations" << std::endl;
+  };
+
+  MeshData cacheOptimized = original;
+  double cacheSeconds = bestOf([&]() {
+    cacheOptimized = original;
+    optimizeVertexCache(cacheOptimized.indices, cacheOptimized.vertices.size());
+  });
+
+  MeshData optimized = original;
+  double totalSeconds = bestOf([&]() {
+    optimized = original;
+    optimizeMesh(optimized);
+  });
+
+  std::cout << args[0] << ": " << original.vertices.size() << " vertices, "
+    << original.indices.size() / 3 << " triangles" << std::endl;
+  reportStats("input             ", original);
+  reportStats("vertex cache      ", cacheOptimized);
+  reportStats("full optimizeMesh ", optimized);
+  std::cout << "  vertex cache pass " << cacheSeconds * 1000.0 << " ms, all passes "
+    << totalSeconds * 1000.0 << " ms" << std::endl;
+}
+
+// What each IndexWidthPolicy costs for a model: 16-bit splits halve index
+// fetch bandwidth but duplicate the vertices shared across a split and add
+// draw calls. Meshes with at most 65536 vertices come out the same either way.
+void benchmarkIndexWidth(const std::vector<std::string>& args) {
+  MeshData mesh = buildMesh(loadObjParallel(args.at(0)));
+  optimizeMesh(mesh);
+
+  std::cout << args[0] << ": " << mesh.vertices.size() << " vertices, "
+    << mesh.indices.size() / 3 << " triangles" << std::endl;
+
+  auto reportPolicy = [&](const char* label, IndexWidthPolicy policy) {
+    PackedMesh packed;
+    double seconds = bestOf([&]() { packed = packIndices(MeshData(mesh), policy); });
+
+    size_t vertexBytes = packed.vertices.size() * sizeof(Vertex);
+    std::cout << "  " << label << packed.indexSize * 8 << "-bit, "
+      << packed.submeshes.size() << " draws, "
+      << packed.vertices.size() << " vertices (+"
+      << 100.0 * (packed.vertices.size() - mesh.vertices.size()) / mesh.vertices.size() << "%), "
+      << packed.indexData.size() / 1024 << " KB indices, "
+      << (packed.indexData.size() + vertexBytes) / 1024 << " KB total, "
+      << seconds * 1000.0 << " ms" << std::endl;
+  };
+
+  reportPolicy("Split16  ", IndexWidthPolicy::Split16);
+  reportPolicy("Widen32  ", IndexWidthPolicy::Widen32);
+}
+
+// Memory saved and precision lost by the packed vertex formats. Vertex has
+// no normals yet, so the octahedral encoding is measured on face normals.
+void benchmarkQuantization(const std::vector<std::string>& args) {
+  MeshData mesh = buildMesh(loadObjParallel(args.at(0)));
+  size_t fullBytes = mesh.vertices.size() * sizeof(Vertex);
+
+  std::cout << args[0] << ": " << mesh.vertices.size() << " vertices, "
+    << fullBytes / 1024 << " KB as Vertex" << std::endl;
+
+  auto reportFormat = [&](const char* label, VertexFormat format) {
+    QuantizedVertices quantized;
+    double seconds = bestOf([&]() {
+      quantized = quantizeVertices(mesh.vertices.data(), mesh.vertices.size(), format);
+    });
+    QuantizationError error =
+      measureQuantizationError(mesh.vertices.data(), mesh.vertices.size(), quantized, format);
+
+    std::cout << "  " << label << quantized.vertices.size() * sizeof(PackedVertex) / 1024 << " KB, "
+      << seconds * 1000.0 << " ms; position max " << error.maxPositionError
+      << " rms " << error.rmsPositionError << " (" << error.relativePositionError * 100.0f
+      << "% of bounds), uv max " << error.maxTexCoordError
+      << ", color max " << error.maxColorError << std::endl;
+  };
+
+  reportFormat("Snorm16  ", VertexFormat::Snorm16);
+  reportFormat("Half     ", VertexFormat::Half);
+
+  float maxAngle = 0.0f;
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    const glm::vec3& p0 = mesh.vertices[mesh.indices[i + 0]].pos;
+    const glm::vec3& p1 = mesh.vertices[mesh.indices[i + 1]].pos;
+    const glm::vec3& p2 = mesh.vertices[mesh.indices[i + 2]].pos;
+
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    if (glm::length(normal) == 0.0f) {
+      continue;
+    }
+    normal = glm::normalize(normal);
+
+    glm::vec3 decoded = decodeOctahedralNormal(encodeOctahedralNormal(normal));
+    float angle = std::acos(std::min(1.0f, glm::dot(normal, decoded)));
+    maxAngle = std::max(maxAngle, angle);
+  }
+
+  std::cout << "  octahedral normals (4 bytes): max error " << maxAngle * 180.0f / 3.14159265f
+    << " degrees over " << mesh.indices.size() / 3 << " face normals" << std::endl;
+}
+
+// Vertex bytes a depth-only pass fetches from an interleaved buffer versus the
+// split position stream, estimated from the post-transform cache misses.
+void benchmarkVertexStreams(const std::vector<std::string>& args) {
+  MeshData mesh = buildMesh(loadObjParallel(args.at(0)));
+  optimizeMesh(mesh);
+
+  VertexCacheStats stats = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+  double fetchedVertices = stats.acmr * mesh.indices.size() / 3.0;
+
+  std::cout << args[0] << ": " << mesh.vertices.size() << " vertices, "
+    << static_cast<size_t>(fetchedVertices) << " vertex fetches per pass" << std::endl;
+
+  auto reportFormat = [&](const char* label, size_t interleavedStride, const VertexStreams& streams) {
+    size_t positionStride = streams.positions.size() / mesh.vertices.size();
+    std::cout << "  " << label << "depth pass " << fetchedVertices * interleavedStride / 1024 << " KB interleaved, "
+      << fetchedVertices * positionStride / 1024 << " KB position stream ("
+      << positionStride << " of " << interleavedStride << " bytes per vertex)" << std::endl;
+  };
+
+  reportFormat("Float32  ", sizeof(Vertex), splitVertexStreams(mesh.vertices.data(), mesh.vertices.size()));
+
+  QuantizedVertices quantized = quantizeVertices(mesh.vertices.data(), mesh.vertices.size(), VertexFormat::Snorm16);
+  reportFormat("Snorm16  ", sizeof(PackedVertex), splitVertexStreams(quantized.vertices));
+}
+
+// Fully associative LRU cache of 64-byte lines, counting misses.
+class TextureCacheModel {
+public:
+  explicit TextureCacheModel(size_t lineCount) : capacity(lineCount) {}
+
+  void access(uint64_t line) {
+    auto found = lines.find(line);
+    if (found != lines.end()) {
+      order.splice(order.begin(), order, found->second);
+      return;
+    }
+
+    misses++;
+    order.push_front(line);
+    lines[line] = order.begin();
+    if (order.size() > capacity) {
+      lines.erase(order.back());
+      order.pop_back();
+    }
+  }
+
+  size_t misses = 0;
+
+private:
+  size_t capacity;
+  std::list<uint64_t> order;
+  std::unordered_map<uint64_t, std::list<uint64_t>::iterator> lines;
+};
+
+// Texture cache traffic of a screen-aligned quad showing a width x height
+// RGBA8 texture from further and further away, simulated on the CPU. Every
+// pixel takes one bilinear sample; texels are stored in 4x4 tiles of one
+// 64-byte line each and go through a 16 KB LRU cache. Pixels are visited in
+// 8x8 tiles, roughly like a rasterizer. Without mips a minified quad skips
+// across the texture and nearly every sample misses.
+void benchmarkMipBandwidth(const std::vector<std::string>& args) {
+  const uint32_t width = static_cast<uint32_t>(std::stoul(args.at(0)));
+  const uint32_t height = static_cast<uint32_t>(std::stoul(args.at(1)));
+  const uint32_t levelCount = mipLevelCount(width, height);
+  const size_t cacheLines = 16 * 1024 / 64;
+  const uint32_t tileSize = 4;
+  const uint32_t pixelTile = 8;
+
+  std::vector<uint64_t> levelFirstLine(levelCount);
+  uint64_t totalLines = 0;
+  for (uint32_t level = 0; level < levelCount; level++) {
+    uint32_t levelWidth = std::max(width >> level, 1u);
+    uint32_t levelHeight = std::max(height >> level, 1u);
+    levelFirstLine[level] = totalLines;
+    totalLines += ((levelWidth + tileSize - 1) / tileSize) * ((levelHeight + tileSize - 1) / tileSize);
+  }
+
+  auto simulate = [&](uint32_t texelsPerPixel, bool mipmapped) {
+    uint32_t screenWidth = std::max(width / texelsPerPixel, 1u);
+    uint32_t screenHeight = std::max(height / texelsPerPixel, 1u);
+
+    uint32_t level = 0;
+    if (mipmapped) {
+      while ((2u << level) <= texelsPerPixel && level + 1 < levelCount) {
+        level++;
+      }
+    }
+    int32_t levelWidth = static_cast<int32_t>(std::max(width >> level, 1u));
+    int32_t levelHeight = static_cast<int32_t>(std::max(height >> level, 1u));
+    int32_t tilesPerRow = (levelWidth + tileSize - 1) / tileSize;
+
+    TextureCacheModel cache(cacheLines);
+    for (uint32_t tileY = 0; tileY < screenHeight; tileY += pixelTile) {
+      for (uint32_t tileX = 0; tileX < screenWidth; tileX += pixelTile) {
+        for (uint32_t y = tileY; y < std::min(tileY + pixelTile, screenHeight); y++) {
+          for (uint32_t x = tileX; x < std::min(tileX + pixelTile, screenWidth); x++) {
+            float u = (x + 0.5f) / screenWidth * levelWidth - 0.5f;
+            float v = (y + 0.5f) / screenHeight * levelHeight - 0.5f;
+            int32_t u0 = static_cast<int32_t>(std::floor(u));
+            int32_t v0 = static_cast<int32_t>(std::floor(v));
+
+            for (int32_t corner = 0; corner < 4; corner++) {
+              int32_t texelX = std::clamp(u0 + (corner & 1), 0, levelWidth - 1);
+              int32_t texelY = std::clamp(v0 + (corner >> 1), 0, levelHeight - 1);
+              cache.access(levelFirstLine[level]
+                + static_cast<uint64_t>(texelY / tileSize) * tilesPerRow + texelX / tileSize);
+            }
+          }
+        }
+      }
+    }
+
+    return std::make_pair(cache.misses * 64.0 / (screenWidth * screenHeight), screenWidth * screenHeight);
+  };
+
+  std::cout << width << "x" << height << " RGBA8, " << levelCount << " mip levels, "
+    << cacheLines * 64 / 1024 << " KB texture cache" << std::endl;
+  std::cout << "  texels/pixel  pixels     bytes/pixel level 0  bytes/pixel mipmapped" << std::endl;
+  for (uint32_t texelsPerPixel = 1; texelsPerPixel <= 64 && texelsPerPixel <= std::max(width, height);
+    texelsPerPixel *= 2)
+  {
+    auto flat = simulate(texelsPerPixel, false);
+    auto mipmapped = simulate(texelsPerPixel, true);
+    std::cout << "  " << std::setw(12) << texelsPerPixel << "  " << std::setw(9) << flat.second
+      << "  " << std::setw(19) << flat.first << "  " << std::setw(21) << mipmapped.first << std::endl;
+  }
+}
+
+// Startup cost and memory footprint of each texture file, e.g. a PNG next to
+// its pre-compressed KTX2 or DDS version. "full chain" is what the texture
+// takes once uploaded, with generated levels added for a single-level image.
+void benchmarkTextureLoad(const std::vector<std::string>& args) {
+  if (args.empty()) {
+    throw std::out_of_range("no texture files");
+  }
+
+  for (const std::string& filename : args) {
+    TextureData texture;
+    double seconds = bestOf([&]() {
+      texture = loadTexture(filename);
+    });
+
+    const TextureLevel& topLevel = texture.levels[0];
+    uint32_t levelCount = texture.levels.size() == 1 && !isBlockCompressed(texture.format)
+      ? mipLevelCount(topLevel.width, topLevel.height)
+      : static_cast<uint32_t>(texture.levels.size());
+    size_t chainSize = 0;
+    for (uint32_t level = 0; level < levelCount; level++) {
+      chainSize += textureLevelSize(
+        texture.format,
+        std::max(topLevel.width >> level, 1u),
+        std::max(topLevel.height >> level, 1u));
+    }
+
+    std::cout << filename << ": " << topLevel.width << "x" << topLevel.height << ", "
+      << texture.levels.size() << " levels in the file" << std::endl;
+    std::cout << "  load        " << seconds * 1000.0 << " ms" << std::endl;
+    if (!texture.file.isOpen()) {
+      // the same decode reading the file through stdio instead of a mapping
+      double stdioSeconds = bestOf([&]() {
+        int width, height, channels;
+        stbi_image_free(stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha));
+      });
+      std::cout << "  stbi_load   " << stdioSeconds * 1000.0 << " ms" << std::endl;
+    }
+    std::cout << "  uploaded    " << texture.uploadSize() / 1024 << " KB" << std::endl;
+    std::cout << "  full chain  " << chainSize / 1024 << " KB, "
+      << chainSize * 8.0 / (static_cast<double>(topLevel.width) * topLevel.height) << " bits/texel of level 0"
+      << std::endl;
+  }
+}
+
+// Decoding a set of textures one after the other against handing them all to
+// a TextureLoader at once.
+void benchmarkTexturePool(const std::vector<std::string>& args) {
+  if (args.empty()) {
+    throw std::out_of_range("no texture files");
+  }
+
+  size_t bytes = 0;
+  double serialSeconds = bestOf([&]() {
+    bytes = 0;
+    for (const std::string& filename : args) {
+      bytes += loadTexture(filename).uploadSize();
+    }
+  });
+
+  TextureLoader loader;
+  double poolSeconds = bestOf([&]() {
+    std::vector<std::future<LoadedTexture>> loads;
+    for (const std::string& filename : args) {
+      loads.push_back(loader.load(filename));
+    }
+    for (auto& load : loads) {
+      load.get();
+    }
+  });
+
+  std::cout << args.size() << " textures, " << bytes / (1024 * 1024) << " MB decoded, "
+    << std::thread::hardware_concurrency() << " threads" << std::endl;
+  std::cout << "  serial        " << serialSeconds * 1000.0 << " ms" << std::endl;
+  std::cout << "  TextureLoader " << poolSeconds * 1000.0 << " ms" << std::endl;
+  std::cout << "  speedup       " << serialSeconds / poolSeconds << "x" << std::endl;
+}
+
+// What the texture cache saves per image: decoding (and mip filtering) on a
+// miss against hashing the source and mapping the entry on a hit. Uses a
+// scratch cache directory that is removed afterwards.
+void benchmarkTextureCache(const std::vector<std::string>& args) {
+  const std::string& filename = args.at(0);
+  const std::string directory = "bench-texture-cache";
+  TextureCache cache(directory, UINT64_MAX, true);
+
+  uint64_t key = 0;
+  double hashSeconds = bestOf([&]() { key = cache.key(filename); });
+
+  TextureData texture;
+  double decodeSeconds = bestOf([&]() { texture = cache.decode(filename); });
+  double writeSeconds = bestOf([&]() { cache.write(key, texture); });
+
+  size_t uploadSize = 0;
+  double hitSeconds = bestOf([&]() {
+    std::optional<TextureData> cached = cache.open(cache.key(filename));
+    if (!cached) {
+      throw std::runtime_error("texture cache missed after a write!");
+    }
+    // touch every byte like the staging copy would
+    std::vector<unsigned char> staging(cached->uploadSize());
+    copyTextureLevels(*cached, staging.data());
+    uploadSize = staging.size();
+  });
+
+  std::filesystem::remove_all(directory);
+
+  std::cout << filename << ": " << fileMegabytes(filename) << " MB, " << texture.levels.size() << " levels, "
+    << uploadSize / 1024 << " KB decoded" << std::endl;
+  std::cout << "  hash source        " << hashSeconds * 1000.0 << " ms" << std::endl;
+  std::cout << "  decode + mips      " << decodeSeconds * 1000.0 << " ms" << std::endl;
+  std::cout << "  write entry        " << writeSeconds * 1000.0 << " ms" << std::endl;
+  std::cout << "  hit (hash + copy)  " << hitSeconds * 1000.0 << " ms" << std::endl;
+  std::cout << "  speedup            " << decodeSeconds / hitSeconds << "x" << std::endl;
+}
+
+// Sub-allocating device memory for a growing number of resources: buffers
+// and images from 256 bytes to 4 MB, images 64 KB aligned and kept 1 KB
+// (bufferImageGranularity) pages apart from buffers. Each round allocates
+// them all and frees them in random order; then half are freed and
+// allocated again to see how fragmented the ranges get.
+void benchmarkSubAllocation(const std::vector<std::string>& args) {
+  const size_t maxResources = args.empty() ? 100000 : std::stoul(args.at(0));
+
+  struct Resource {
+    uint64_t size;
+    uint64_t alignment;
+    bool linear;
+  };
+
+  std::cout << "resources   allocate+free   free ranges   fragmentation" << std::endl;
+  for (size_t resourceCount = std::min<size_t>(maxResources, 1000); resourceCount <= maxResources; resourceCount *= 10) {
+    std::mt19937_64 random(1);
+    std::vector<Resource> resources(resourceCount);
+    uint64_t totalBytes = 0;
+    for (Resource& resource : resources) {
+      resource.linear = random() % 2 == 0;
+      resource.size = uint64_t(256) << (random() % 15);
+      resource.size += random() % resource.size;
+      resource.alignment = resource.linear ? 256 : 64 * 1024;
+      totalBytes += resource.size + resource.alignment;
+    }
+
+    std::vector<size_t> freeOrder(resourceCount);
+    for (size_t i = 0; i < resourceCount; i++) {
+      freeOrder[i] = i;
+    }
+    std::shuffle(freeOrder.begin(), freeOrder.end(), random);
+
+    // room for all of them plus a third, as if blocks were a third empty
+    const uint64_t rangeSize = totalBytes + totalBytes / 3;
+    std::vector<uint32_t> nodes(resourceCount);
+
+    double seconds = bestOf([&]() {
+      TlsfAllocator allocator(rangeSize, 1024);
+      for (size_t i = 0; i < resourceCount; i++) {
+        const Resource& resource = resources[i];
+        nodes[i] = allocator.allocate(resource.size, resource.alignment, resource.linear).value().node;
+      }
+      for (size_t i : freeOrder) {
+        allocator.free(nodes[i]);
+      }
+    });
+
+    TlsfAllocator allocator(rangeSize, 1024);
+    for (size_t i = 0; i < resourceCount; i++) {
+      const Resource& resource = resources[i];
+      nodes[i] = allocator.allocate(resource.size, resource.alignment, resource.linear).value().node;
+    }
+    for (size_t i = 0; i < resourceCount / 2; i++) {
+      allocator.free(nodes[freeOrder[i]]);
+    }
+    size_t failed = 0;
+    for (size_t i = 0; i < resourceCount / 2; i++) {
+      const Resource& resource = resources[freeOrder[i]];
+      if (!allocator.allocate(resource.size, resource.alignment, resource.linear)) {
+        failed++;
+      }
+    }
+
+    uint64_t freeBytes = allocator.size() - allocator.usedBytes();
+    double fragmentation = freeBytes > 0 ? 1.0 - double(allocator.largestFreeRange()) / double(freeBytes) : 0.0;
+
+    std::cout << std::setw(9) << resourceCount
+      << std::setw(13) << std::fixed << std::setprecision(1) << seconds * 1e9 / resourceCount << " ns"
+      << std::setw(14) << allocator.freeRangeCount()
+      << std::setw(15) << std::setprecision(1) << fragmentation * 100.0 << "%";
+    if (failed > 0) {
+      std::cout << " (" << failed << " did not fit again)";
+    }
+    std::cout << std::defaultfloat << std::endl;
+  }
+}
+
+struct Benchmark {
+  const char* name;
+  const char* arguments;
+  std::function<void(const std::vector<std::string>&)> run;
+};
+
+const std::vector<Benchmark> benchmarks = {
+  { "obj", "<file.obj>", benchmarkObjLoader },
+  { "dedup", "<file.obj>", benchmarkDedup },
+  { "meshcache", "<file.obj>", benchmarkMeshCache },
+  { "optimize", "<file.obj>", benchmarkOptimizer },
+  { "indexwidth", "<file.obj>", benchmarkIndexWidth },
+  { "quantize", "<file.obj>", benchmarkQuantization },
+  { "streams", "<file.obj>", benchmarkVertexStreams },
+  { "mipbandwidth", "<width> <height>", benchmarkMipBandwidth },
+  { "textureload", "<texture> [<texture>...]", benchmarkTextureLoad },
+  { "texturepool", "<texture> [<texture>...]", benchmarkTexturePool },
+  { "texturecache", "<image>", benchmarkTextureCache },
+  { "suballoc", "[<resources>]", benchmarkSubAllocation },
+};
+
+void printUsage() {
+  std::cerr << "usage: vulkan-playground-bench <benchmark> [arguments...]" << std::endl;
+  for (const auto& benchmark : benchmarks) {
+    std::cerr << "  " << benchmark.name << " " << benchmark.arguments << std::endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  std::string name = argv[1];
+  std::vector<std::string> args(argv + 2, argv + argc);
+
+  for (const auto& benchmark : benchmarks) {
+    if (name != benchmark.name) {
+      continue;
+    }
+
+    try {
+      benchmark.run(args);
+    } catch (const std::out_of_range&) {
+      printUsage();
+      return EXIT_FAILURE;
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  printUsage();
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,466 @@
+#include "device_allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// How well memory with flags suits usage, higher is better; -1 when it
+// cannot serve it at all.
+int memoryTypeScore(VkMemoryPropertyFlags flags, MemoryUsage usage) {
+  const VkMemoryPropertyFlags hostAccess = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  if (flags & (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT)) {
+    return -1;
+  }
+  if (usage != MemoryUsage::GpuOnly && (flags & hostAccess) != hostAccess) {
+    return -1;
+  }
+
+  bool deviceLocal = flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  bool hostVisible = flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  bool hostCached = flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+  switch (usage) {
+  case MemoryUsage::GpuOnly:
+    // host-visible VRAM is scarce without resizable BAR, it is left to the
+    // CPU's writes
+    return (deviceLocal ? 4 : 0) + (hostVisible ? 0 : 1);
+  case MemoryUsage::Upload:
+    // write-combined system memory, read once by a transfer
+    return (deviceLocal ? 0 : 2) + (hostCached ? 0 : 1);
+  case MemoryUsage::Readback:
+    return (hostCached ? 4 : 0) + (deviceLocal ? 0 : 1);
+  case MemoryUsage::PerFrame:
+    // CPU writes go straight to the VRAM the GPU reads them from every frame
+    return (deviceLocal ? 4 : 0) + (hostCached ? 0 : 1);
+  }
+  return -1;
+}
+
+} // namespace
+
+const char* memoryUsageName(MemoryUsage usage) {
+  switch (usage) {
+  case MemoryUsage::GpuOnly:
+    return "GPU only";
+  case MemoryUsage::Upload:
+    return "upload";
+  case MemoryUsage::Readback:
+    return "readback";
+  case MemoryUsage::PerFrame:
+    return "per frame";
+  }
+  return "unknown";
+}
+
+DeviceAllocator::DeviceAllocator(
+  VkPhysicalDevice physicalDevice,
+  VkDevice device,
+  bool memoryBudget,
+  VkDeviceSize preferredBlockSize)
+  : physicalDevice(physicalDevice), device(device), memoryBudget(memoryBudget), preferredBlockSize(preferredBlockSize)
+{
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  bufferImageGranularity = properties.limits.bufferImageGranularity;
+
+  blocks.resize(memoryProperties.memoryTypeCount);
+  heapBytes.resize(memoryProperties.memoryHeapCount);
+  for (size_t usage = 0; usage < memoryUsageCount; usage++) {
+    placementCounts[usage].resize(memoryProperties.memoryTypeCount);
+    placementBytes[usage].resize(memoryProperties.memoryTypeCount);
+  }
+}
+
+DeviceAllocator::~DeviceAllocator() {
+  for (const auto& typeBlocks : blocks) {
+    for (const auto& block : typeBlocks) {
+      if (block) {
+        vkFreeMemory(device, block->memory, nullptr);
+      }
+    }
+  }
+}
+
+DeviceAllocation DeviceAllocator::allocate(
+  const VkMemoryRequirements& requirements,
+  MemoryUsage usage,
+  bool linear,
+  bool movable)
+{
+  std::vector<uint32_t> memoryTypes = rankMemoryTypes(requirements.memoryTypeBits, usage);
+  if (memoryTypes.empty()) {
+    throw std::runtime_error("failed to find suitable memory type!");
+  }
+
+  DeviceAllocation allocation;
+  allocation.size = requirements.size;
+  allocation.usage = usage;
+
+  auto allocateIn = [&](uint32_t memoryType, bool checkBudget) {
+    allocation.memoryType = memoryType;
+    if (requirements.size > blockSize(memoryType) / 2) {
+      return (!checkBudget || withinBudget(memoryType, requirements.size))
+        && allocateDedicated(requirements, allocation);
+    }
+    return allocateFromBlocks(requirements, linear, allocation)
+      || ((!checkBudget || withinBudget(memoryType, blockSize(memoryType)))
+        && allocateBlock(requirements, linear, allocation));
+  };
+
+  // lesser types are only used when the better ones are over budget or out
+  // of memory, and going over budget only when all of them are
+  bool allocated = false;
+  for (size_t i = 0; i < memoryTypes.size() && !allocated; i++) {
+    allocated = allocateIn(memoryTypes[i], true);
+    if (allocated && i > 0) {
+      fallbackCount++;
+    }
+  }
+  for (size_t i = 0; i < memoryTypes.size() && !allocated; i++) {
+    allocated = allocateIn(memoryTypes[i], false);
+    if (allocated) {
+      overBudgetCount++;
+    }
+  }
+
+  if (!allocated) {
+    throw std::runtime_error("failed to allocate device memory!");
+  }
+
+  if (allocation.block != dedicatedBlock) {
+    Block& block = *blocks[allocation.memoryType][allocation.block];
+    block.residents[allocation.node] = Resident{ requirements.size, requirements.alignment, linear, movable };
+    if (!movable) {
+      block.pinnedCount++;
+    }
+  }
+
+  placed(allocation, 1);
+  return allocation;
+}
+
+void DeviceAllocator::free(const DeviceAllocation& allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) {
+    return;
+  }
+
+  placed(allocation, -1);
+
+  if (allocation.block == dedicatedBlock) {
+    freeMemory(allocation.memory, allocation.memoryType, allocation.size);
+    dedicatedCount--;
+    dedicatedBytes -= allocation.size;
+    return;
+  }
+
+  auto& typeBlocks = blocks[allocation.memoryType];
+  std::unique_ptr<Block>& block = typeBlocks[allocation.block];
+  block->ranges.free(allocation.node);
+  auto resident = block->residents.find(allocation.node);
+  if (!resident->second.movable) {
+    block->pinnedCount--;
+  }
+  block->residents.erase(resident);
+
+  // keep one block per type around so a type that is used at all does not
+  // allocate and free a block over and over
+  if (block->ranges.allocationCount() == 0) {
+    size_t liveBlocks = std::count_if(typeBlocks.begin(), typeBlocks.end(), [](const auto& b) { return b != nullptr; });
+    if (liveBlocks > 1) {
+      freeMemory(block->memory, allocation.memoryType, block->ranges.size());
+      block.reset();
+    }
+  }
+}
+
+uint32_t DeviceAllocator::beginDefragmentation(float maxUsage) {
+  uint32_t count = 0;
+  for (auto& typeBlocks : blocks) {
+    std::vector<Block*> candidates;
+    // copies of the free ranges of the blocks that stay, which the resources
+    // of marked blocks are placed in
+    std::vector<std::pair<Block*, TlsfAllocator>> destinations;
+    for (const auto& block : typeBlocks) {
+      if (!block || block->evacuating) {
+        continue;
+      }
+      destinations.emplace_back(block.get(), block->ranges);
+      if (block->pinnedCount == 0 && block->ranges.usedBytes() <= VkDeviceSize(maxUsage * block->ranges.size())) {
+        candidates.push_back(block.get());
+      }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Block* a, const Block* b) {
+      return a->ranges.usedBytes() < b->ranges.usedBytes();
+    });
+
+    for (Block* block : candidates) {
+      auto self = std::find_if(destinations.begin(), destinations.end(), [&](const auto& d) { return d.first == block; });
+      std::vector<std::pair<Block*, TlsfAllocator>> trial = destinations;
+      trial.erase(trial.begin() + (self - destinations.begin()));
+
+      std::vector<TlsfAllocator*> ranges;
+      for (auto& destination : trial) {
+        ranges.push_back(&destination.second);
+      }
+      if (!placeResidents(*block, ranges)) {
+        continue;
+      }
+
+      block->evacuating = true;
+      destinations = std::move(trial);
+      count++;
+    }
+  }
+  return count;
+}
+
+// Places the residents of block in destinations, largest first and each in
+// the first that has room, the way allocateFromBlocks will when they move.
+bool DeviceAllocator::placeResidents(const Block& block, std::vector<TlsfAllocator*>& destinations) {
+  std::vector<Resident> residents;
+  for (const auto& resident : block.residents) {
+    residents.push_back(resident.second);
+  }
+  std::sort(residents.begin(), residents.end(), [](const Resident& a, const Resident& b) {
+    return a.size > b.size;
+  });
+
+  for (const Resident& resident : residents) {
+    bool placed = false;
+    for (size_t i = 0; i < destinations.size() && !placed; i++) {
+      placed = destinations[i]->allocate(resident.size, resident.alignment, resident.linear).has_value();
+    }
+    if (!placed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DeviceAllocator::evacuating(const DeviceAllocation& allocation) const {
+  if (allocation.memory == VK_NULL_HANDLE || allocation.block == dedicatedBlock) {
+    return false;
+  }
+  const Block* block = blocks[allocation.memoryType][allocation.block].get();
+  return block && block->evacuating;
+}
+
+void DeviceAllocator::endDefragmentation() {
+  for (const auto& typeBlocks : blocks) {
+    for (const auto& block : typeBlocks) {
+      if (block) {
+        block->evacuating = false;
+      }
+    }
+  }
+}
+
+DeviceAllocatorStats DeviceAllocator::stats() const {
+  DeviceAllocatorStats result{};
+  result.dedicatedCount = dedicatedCount;
+  result.dedicatedBytes = dedicatedBytes;
+  result.overBudgetCount = overBudgetCount;
+  result.fallbackCount = fallbackCount;
+  result.memoryBudget = memoryBudget;
+
+  VkDeviceSize freeBytes = 0;
+  VkDeviceSize largestFreeBytes = 0;
+  for (const auto& typeBlocks : blocks) {
+    for (const auto& block : typeBlocks) {
+      if (!block) {
+        continue;
+      }
+      result.blockCount++;
+      result.blockBytes += block->ranges.size();
+      result.allocationCount += block->ranges.allocationCount();
+      result.usedBytes += block->ranges.usedBytes();
+      result.freeRangeCount += block->ranges.freeRangeCount();
+      freeBytes += block->ranges.size() - block->ranges.usedBytes();
+      largestFreeBytes += block->ranges.largestFreeRange();
+    }
+  }
+  result.fragmentation = freeBytes > 0 ? 1.0f - float(largestFreeBytes) / float(freeBytes) : 0.0f;
+
+  for (size_t usage = 0; usage < memoryUsageCount; usage++) {
+    for (uint32_t memoryType = 0; memoryType < memoryProperties.memoryTypeCount; memoryType++) {
+      if (placementCounts[usage][memoryType] > 0) {
+        result.placements.push_back(MemoryPlacement{
+          static_cast<MemoryUsage>(usage),
+          memoryType,
+          memoryProperties.memoryTypes[memoryType].propertyFlags,
+          memoryProperties.memoryTypes[memoryType].heapIndex,
+          placementCounts[usage][memoryType],
+          placementBytes[usage][memoryType] });
+      }
+    }
+  }
+
+  std::vector<HeapBudget> budgets = heapBudgets();
+  for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+    result.heaps.push_back(MemoryHeapStats{
+      memoryProperties.memoryHeaps[heap].size,
+      (memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0,
+      budgets[heap].budget,
+      budgets[heap].usage,
+      heapBytes[heap] });
+  }
+
+  return result;
+}
+
+// Memory types allowed by memoryTypeBits that can serve usage, best first.
+std::vector<uint32_t> DeviceAllocator::rankMemoryTypes(uint32_t memoryTypeBits, MemoryUsage usage) const {
+  std::vector<uint32_t> memoryTypes;
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    if ((memoryTypeBits & (1u << i)) && memoryTypeScore(memoryProperties.memoryTypes[i].propertyFlags, usage) >= 0) {
+      memoryTypes.push_back(i);
+    }
+  }
+
+  std::stable_sort(memoryTypes.begin(), memoryTypes.end(), [&](uint32_t a, uint32_t b) {
+    return memoryTypeScore(memoryProperties.memoryTypes[a].propertyFlags, usage)
+      > memoryTypeScore(memoryProperties.memoryTypes[b].propertyFlags, usage);
+  });
+  return memoryTypes;
+}
+
+bool DeviceAllocator::allocateFromBlocks(const VkMemoryRequirements& requirements, bool linear, DeviceAllocation& allocation) {
+  auto& typeBlocks = blocks[allocation.memoryType];
+  for (uint32_t i = 0; i < typeBlocks.size(); i++) {
+    Block* block = typeBlocks[i].get();
+    if (!block || block->evacuating) {
+      continue;
+    }
+
+    std::optional<TlsfAllocation> range = block->ranges.allocate(requirements.size, requirements.alignment, linear);
+    if (range) {
+      allocation.memory = block->memory;
+      allocation.offset = range->offset;
+      allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + range->offset : nullptr;
+      allocation.block = i;
+      allocation.node = range->node;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DeviceAllocator::allocateBlock(const VkMemoryRequirements& requirements, bool linear, DeviceAllocation& allocation) {
+  VkDeviceSize size = blockSize(allocation.memoryType);
+  VkDeviceMemory memory;
+  void* mapped;
+  if (!allocateMemory(size, allocation.memoryType, memory, mapped)) {
+    return false;
+  }
+
+  auto block = std::unique_ptr<Block>(new Block{ memory, mapped, TlsfAllocator(size, bufferImageGranularity) });
+
+  // a fresh block always has room for half its size
+  TlsfAllocation range = *block->ranges.allocate(requirements.size, requirements.alignment, linear);
+
+  auto& typeBlocks = blocks[allocation.memoryType];
+  auto slot = std::find(typeBlocks.begin(), typeBlocks.end(), nullptr);
+  if (slot == typeBlocks.end()) {
+    slot = typeBlocks.insert(typeBlocks.end(), nullptr);
+  }
+  *slot = std::move(block);
+
+  allocation.memory = memory;
+  allocation.offset = range.offset;
+  allocation.mapped = mapped ? static_cast<char*>(mapped) + range.offset : nullptr;
+  allocation.block = static_cast<uint32_t>(slot - typeBlocks.begin());
+  allocation.node = range.node;
+  return true;
+}
+
+bool DeviceAllocator::allocateDedicated(const VkMemoryRequirements& requirements, DeviceAllocation& allocation) {
+  if (!allocateMemory(requirements.size, allocation.memoryType, allocation.memory, allocation.mapped)) {
+    return false;
+  }
+
+  allocation.offset = 0;
+  allocation.block = dedicatedBlock;
+  dedicatedCount++;
+  dedicatedBytes += requirements.size;
+  return true;
+}
+
+// False when the heap is out of memory, so another type can be tried.
+bool DeviceAllocator::allocateMemory(VkDeviceSize size, uint32_t memoryType, VkDeviceMemory& memory, void*& mapped) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+  VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+  if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) {
+    return false;
+  }
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate device memory!");
+  }
+
+  mapped = nullptr;
+  if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+      vkFreeMemory(device, memory, nullptr);
+      throw std::runtime_error("failed to map device memory!");
+    }
+  }
+
+  heapBytes[memoryProperties.memoryTypes[memoryType].heapIndex] += size;
+  return true;
+}
+
+void DeviceAllocator::freeMemory(VkDeviceMemory memory, uint32_t memoryType, VkDeviceSize size) {
+  vkFreeMemory(device, memory, nullptr);
+  heapBytes[memoryProperties.memoryTypes[memoryType].heapIndex] -= size;
+}
+
+// Small heaps, like the host-visible device-local window without resizable
+// BAR, get blocks small enough that a few of them fit.
+VkDeviceSize DeviceAllocator::blockSize(uint32_t memoryType) const {
+  uint32_t heap = memoryProperties.memoryTypes[memoryType].heapIndex;
+  return std::min(preferredBlockSize, memoryProperties.memoryHeaps[heap].size / 8);
+}
+
+bool DeviceAllocator::withinBudget(uint32_t memoryType, VkDeviceSize size) const {
+  HeapBudget heap = heapBudgets()[memoryProperties.memoryTypes[memoryType].heapIndex];
+  return heap.usage + size <= heap.budget;
+}
+
+std::vector<DeviceAllocator::HeapBudget> DeviceAllocator::heapBudgets() const {
+  std::vector<HeapBudget> budgets(memoryProperties.memoryHeapCount);
+
+  if (memoryBudget) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budgetProperties;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+      budgets[heap] = HeapBudget{ budgetProperties.heapBudget[heap], budgetProperties.heapUsage[heap] };
+    }
+  } else {
+    // leave a fifth of each heap to the driver and everyone else
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+      budgets[heap] = HeapBudget{ memoryProperties.memoryHeaps[heap].size / 5 * 4, heapBytes[heap] };
+    }
+  }
+
+  return budgets;
+}
+
+void DeviceAllocator::placed(const DeviceAllocation& allocation, int32_t count) {
+  size_t usage = static_cast<size_t>(allocation.usage);
+  placementCounts[usage][allocation.memoryType] += count;
+  placementBytes[usage][allocation.memoryType] += count * static_cast<int64_t>(allocation.size);
+}
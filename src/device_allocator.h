@@ -0,0 +1,185 @@
+#pragma once
+
+#include "tlsf_allocator.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// What a resource's memory is for, which decides the memory type it gets.
+// Host-visible memory is always host-coherent.
+enum class MemoryUsage {
+  GpuOnly, // written by transfers, read by the GPU
+  Upload, // written once by the CPU, read by transfers
+  Readback, // written by the GPU, read by the CPU
+  PerFrame, // rewritten by the CPU every frame, read by shaders
+};
+
+const size_t memoryUsageCount = 4;
+
+const char* memoryUsageName(MemoryUsage usage);
+
+// Where DeviceAllocator put a resource: bind it at offset in memory.
+struct DeviceAllocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // host-visible memory stays mapped for as long as it is allocated
+  void* mapped = nullptr;
+
+  // for free
+  MemoryUsage usage = MemoryUsage::GpuOnly;
+  uint32_t memoryType = 0;
+  uint32_t block = 0;
+  uint32_t node = 0;
+};
+
+// Live resources of one usage in one memory type.
+struct MemoryPlacement {
+  MemoryUsage usage;
+  uint32_t memoryType;
+  VkMemoryPropertyFlags flags;
+  uint32_t heap;
+  uint32_t resourceCount;
+  VkDeviceSize bytes;
+};
+
+struct MemoryHeapStats {
+  VkDeviceSize size;
+  bool deviceLocal;
+  // from VK_EXT_memory_budget, counting other processes too; without it the
+  // budget is most of the heap and the usage is this allocator's
+  VkDeviceSize budget;
+  VkDeviceSize usage;
+  VkDeviceSize allocatorBytes; // blocks and memory of their own
+};
+
+struct DeviceAllocatorStats {
+  uint32_t blockCount;
+  VkDeviceSize blockBytes;
+  uint32_t dedicatedCount;
+  VkDeviceSize dedicatedBytes;
+  uint32_t allocationCount; // in blocks
+  VkDeviceSize usedBytes; // in blocks
+  uint32_t freeRangeCount;
+  // 0 when the free space of each block is one range, towards 1 the more of
+  // it is in ranges smaller than the largest
+  float fragmentation;
+  // allocations that went over a heap's budget, or to a lesser memory type
+  // because of it
+  uint32_t overBudgetCount;
+  uint32_t fallbackCount;
+
+  bool memoryBudget; // whether the heaps' budget and usage are the driver's
+  std::vector<MemoryPlacement> placements;
+  std::vector<MemoryHeapStats> heaps;
+};
+
+// Sub-allocates buffers and images from a few large VkDeviceMemory blocks
+// per memory type instead of one allocation per resource, which runs into
+// maxMemoryAllocationCount and pays the driver for every mesh and texture.
+// Resources larger than half a block get memory of their own.
+//
+// Memory types are ranked by how well they suit the usage: per-frame data
+// goes to device-local host-visible memory where there is any (all of VRAM
+// with resizable BAR), so CPU writes land in VRAM directly; GPU-only data
+// stays out of it. New blocks go to the best type whose heap is within
+// budget, and only over budget when no type is.
+class DeviceAllocator {
+public:
+  // memoryBudget when VK_EXT_memory_budget is enabled on device
+  DeviceAllocator(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    bool memoryBudget,
+    VkDeviceSize preferredBlockSize = 64ull * 1024 * 1024);
+  ~DeviceAllocator();
+
+  DeviceAllocator(const DeviceAllocator&) = delete;
+  DeviceAllocator& operator=(const DeviceAllocator&) = delete;
+
+  // linear is false for optimal tiling images, which are kept
+  // bufferImageGranularity apart from linear resources. movable when the
+  // caller moves the resource out of blocks being defragmented; blocks
+  // holding any other resource are never marked.
+  DeviceAllocation allocate(
+    const VkMemoryRequirements& requirements,
+    MemoryUsage usage,
+    bool linear,
+    bool movable);
+  void free(const DeviceAllocation& allocation);
+
+  // Incremental defragmentation. beginDefragmentation marks the blocks at
+  // most maxUsage full that hold only movable resources, sparsest first, as
+  // long as placing those resources in the free ranges of the other blocks
+  // of their type succeeds, and returns how many it marked. Marked blocks get
+  // no new allocations, so a resource moved by allocating it again lands
+  // elsewhere, and a block is freed with its last resource as usual.
+  uint32_t beginDefragmentation(float maxUsage);
+  // whether allocation is in a block being emptied
+  bool evacuating(const DeviceAllocation& allocation) const;
+  void endDefragmentation();
+
+  DeviceAllocatorStats stats() const;
+
+private:
+  // What a resource asked for, to place it again.
+  struct Resident {
+    VkDeviceSize size;
+    VkDeviceSize alignment;
+    bool linear;
+    bool movable;
+  };
+
+  struct Block {
+    VkDeviceMemory memory;
+    void* mapped;
+    TlsfAllocator ranges;
+    bool evacuating = false;
+    std::unordered_map<uint32_t, Resident> residents; // by node
+    uint32_t pinnedCount = 0; // residents that cannot be moved
+  };
+
+  struct HeapBudget {
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+  };
+
+  static constexpr uint32_t dedicatedBlock = UINT32_MAX;
+
+  std::vector<uint32_t> rankMemoryTypes(uint32_t memoryTypeBits, MemoryUsage usage) const;
+  bool allocateFromBlocks(const VkMemoryRequirements& requirements, bool linear, DeviceAllocation& allocation);
+  bool allocateBlock(const VkMemoryRequirements& requirements, bool linear, DeviceAllocation& allocation);
+  bool allocateDedicated(const VkMemoryRequirements& requirements, DeviceAllocation& allocation);
+  bool allocateMemory(VkDeviceSize size, uint32_t memoryType, VkDeviceMemory& memory, void*& mapped);
+  void freeMemory(VkDeviceMemory memory, uint32_t memoryType, VkDeviceSize size);
+
+  VkDeviceSize blockSize(uint32_t memoryType) const;
+  bool withinBudget(uint32_t memoryType, VkDeviceSize size) const;
+  std::vector<HeapBudget> heapBudgets() const;
+  void placed(const DeviceAllocation& allocation, int32_t count);
+  static bool placeResidents(const Block& block, std::vector<TlsfAllocator*>& destinations);
+
+  VkPhysicalDevice physicalDevice;
+  VkDevice device;
+  bool memoryBudget;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  VkDeviceSize preferredBlockSize;
+  VkDeviceSize bufferImageGranularity;
+
+  // per memory type; freed blocks leave an empty slot
+  std::vector<std::vector<std::unique_ptr<Block>>> blocks;
+  uint32_t dedicatedCount = 0;
+  VkDeviceSize dedicatedBytes = 0;
+  std::vector<VkDeviceSize> heapBytes;
+  uint32_t overBudgetCount = 0;
+  uint32_t fallbackCount = 0;
+
+  // live resources and their bytes, per usage and memory type
+  std::array<std::vector<uint32_t>, memoryUsageCount> placementCounts;
+  std::array<std::vector<VkDeviceSize>, memoryUsageCount> placementBytes;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SPIR-V compiled from shaders/ by the build. The table is generated by
+// EmbedSpirv.cmake and ends with an entry whose name is null.
+struct EmbeddedShader {
+  const char* name; // source file name, e.g. "shader.vert"
+  const uint32_t* code;
+  size_t size; // in bytes
+};
+
+extern const EmbeddedShader embeddedShaders[];
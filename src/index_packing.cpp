@@ -0,0 +1,86 @@
+#include "index_packing.h"
+
+#include <cstring>
+
+namespace {
+
+template<typename Index>
+void storeIndices(PackedMesh& packed, const std::vector<Index>& indices) {
+  packed.indexSize = sizeof(Index);
+  packed.indexCount = indices.size();
+  packed.indexData.resize(indices.size() * sizeof(Index));
+  memcpy(packed.indexData.data(), indices.data(), packed.indexData.size());
+}
+
+// Greedily cuts the triangle list into runs that reference at most
+// maxVertices16 distinct vertices. Each run gets its own copy of the vertices
+// it uses, in first-use order, and indices relative to them.
+void splitMesh(const MeshData& mesh, PackedMesh& packed) {
+  const uint32_t notInSubmesh = UINT32_MAX;
+
+  // localIndex[v] is only valid while owner[v] is the current submesh, which
+  // saves clearing the table at every split
+  std::vector<uint32_t> localIndex(mesh.vertices.size());
+  std::vector<uint32_t> owner(mesh.vertices.size(), notInSubmesh);
+  std::vector<uint16_t> indices(mesh.indices.size());
+
+  uint32_t submesh = 0;
+  Submesh current{ 0, 0, 0 };
+  uint32_t localVertexCount = 0;
+
+  for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+    uint32_t newVertices = 0;
+    for (size_t corner = t; corner < t + 3; corner++) {
+      newVertices += owner[mesh.indices[corner]] != submesh ? 1 : 0;
+    }
+
+    // corners of one triangle can repeat a vertex, which only overcounts
+    if (localVertexCount + newVertices > maxVertices16) {
+      packed.submeshes.push_back(current);
+      submesh++;
+      current = Submesh{ static_cast<uint32_t>(t), 0, static_cast<uint32_t>(packed.vertices.size()) };
+      localVertexCount = 0;
+    }
+
+    for (size_t corner = t; corner < t + 3; corner++) {
+      uint32_t vertex = mesh.indices[corner];
+      if (owner[vertex] != submesh) {
+        owner[vertex] = submesh;
+        localIndex[vertex] = localVertexCount++;
+        packed.vertices.push_back(mesh.vertices[vertex]);
+      }
+      indices[corner] = static_cast<uint16_t>(localIndex[vertex]);
+    }
+    current.indexCount += 3;
+  }
+
+  if (current.indexCount > 0) {
+    packed.submeshes.push_back(current);
+  }
+
+  storeIndices(packed, indices);
+}
+
+} // namespace
+
+PackedMesh packIndices(MeshData&& mesh, IndexWidthPolicy policy) {
+  PackedMesh packed;
+
+  if (mesh.vertices.size() > maxVertices16 && policy == IndexWidthPolicy::Split16) {
+    splitMesh(mesh, packed);
+    return packed;
+  }
+
+  if (mesh.vertices.size() <= maxVertices16) {
+    std::vector<uint16_t> narrowIndices(mesh.indices.begin(), mesh.indices.end());
+    storeIndices(packed, narrowIndices);
+  } else {
+    storeIndices(packed, mesh.indices);
+  }
+
+  packed.vertices = std::move(mesh.vertices);
+  if (packed.indexCount > 0) {
+    packed.submeshes.push_back(Submesh{ 0, static_cast<uint32_t>(packed.indexCount), 0 });
+  }
+  return packed;
+}
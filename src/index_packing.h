@@ -0,0 +1,39 @@
+#pragma once
+
+#include "mesh_builder.h"
+
+#include <cstdint>
+#include <vector>
+
+// Largest vertex count that 16-bit indices can address.
+const size_t maxVertices16 = UINT16_MAX + 1;
+
+// What to do with a mesh that has more vertices than 16-bit indices reach.
+// Meshes that fit always get 16-bit indices.
+enum class IndexWidthPolicy {
+  // split into submeshes of at most maxVertices16 vertices each, drawn with
+  // a vertexOffset; vertices shared across a split are duplicated
+  Split16,
+  // keep one draw and use 32-bit indices for the whole mesh
+  Widen32,
+};
+
+// One vkCmdDrawIndexed worth of a packed mesh.
+struct Submesh {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t vertexOffset;
+};
+
+// Vertices and indices in the form they are uploaded and drawn in.
+struct PackedMesh {
+  std::vector<Vertex> vertices;
+  uint32_t indexSize = 2; // bytes per index, 2 or 4
+  uint64_t indexCount = 0;
+  std::vector<char> indexData; // indexCount * indexSize bytes
+  std::vector<Submesh> submeshes;
+};
+
+// Picks the index width for mesh and converts it accordingly. Splitting keeps
+// the triangle order, so a vertex cache optimized mesh stays optimized.
+PackedMesh packIndices(MeshData&& mesh, IndexWidthPolicy policy);
@@ -11,8 +11,11 @@
 #include <set>
 #include <cstdint>
 #include <algorithm>
-#include <fstream>
 #include <array>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <functional>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -21,14 +24,93 @@
 
 #include <chrono>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#include "vertex.h"
+#include "obj_loader.h"
+#include "mesh_builder.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "index_packing.h"
+#include "vertex_quantization.h"
+#include "vertex_streams.h"
+#include "texture.h"
+#include "texture_loader.h"
+#include "asset_streamer.h"
+#include "shader_library.h"
+#include "pipeline_cache.h"
+#include "pipeline_compiler.h"
+#include "ring_allocator.h"
+#include "device_allocator.h"
+#include "texture_residency.h"
 
 const int windowWidth = 1024;
 const int windowHeight = 768;
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// replaces the built-in quads below when present
+const std::string modelPath = "models/model.obj";
+
+// reorder imported models for the post-transform cache, overdraw and vertex
+// fetch before they are uploaded (and cached)
+const bool optimizeModel = true;
+
+// how to draw models with more vertices than 16-bit indices can address;
+// see the indexwidth benchmark for what each choice costs
+const IndexWidthPolicy indexWidthPolicy = IndexWidthPolicy::Split16;
+
+// layout the vertex buffer is uploaded in; the packed formats halve vertex
+// memory and fetch bandwidth, see the quantize benchmark for their error
+const VertexFormat vertexFormat = VertexFormat::Snorm16;
+
+// lay down depth with a position-only pipeline first, so the main pass only
+// shades visible fragments; an extra geometry pass that only pays off with
+// expensive fragment shading and overdraw, so it is off by default
+const bool depthPrepass = false;
+
+const std::string texturePath = "textures/statue.png";
+
+// where the camera looks at the model from; assets nearer to it stream first
+const glm::vec3 cameraPosition(2.0f, 2.0f, 2.0f);
+
+// pre-compressed versions of texturePath, tried in order; they are uploaded
+// as they are, with their own mip levels, instead of decoding the image
+const std::vector<std::string> compressedTextureExtensions = { ".ktx2", ".dds" };
+
+// decoded images are cached here by content, with their mip chains, so later
+// runs skip PNG decoding; least recently used entries go above the limit
+const std::string textureCacheDirectory = "cache/textures";
+const uint64_t textureCacheMaxBytes = 512ull * 1024 * 1024;
+
+// driver pipeline cache, loaded at startup and saved at shutdown so warm
+// starts skip shader compilation
+const std::string pipelineCachePath = "cache/pipelines.bin";
+
+// persistently mapped staging memory shared by all uploads; an upload's part
+// is reused once its copies have run, uploads larger than this get a staging
+// buffer of their own
+const VkDeviceSize stagingRingSize = 64ull * 1024 * 1024;
+
+// textures on the GPU are kept within this many bytes by dropping the top
+// mip levels of those drawn with least recently; textures not drawn with for
+// textureIdleFrames frames are evicted outright
+const uint64_t textureBudgetBytes = 256ull * 1024 * 1024;
+const uint64_t textureIdleFrames = 600;
+
+// bytes of uniform data each frame can hand out, see UniformArena
+const VkDeviceSize uniformArenaRegionSize = 64 * 1024;
+
+// textures alive at once, each with its own descriptor set: the placeholder,
+// the model texture, copies of it being made and ones waiting to be freed
+const uint32_t maxTextureDescriptorSets = 16;
+
+// every defragmentationInterval frames, device memory blocks at most
+// defragmentationMaxBlockUsage full are emptied by moving their resources
+// into the other blocks, starting copies of at most
+// defragmentationBytesPerFrame a frame
+const uint64_t defragmentationInterval = 600;
+const float defragmentationMaxBlockUsage = 0.5f;
+const VkDeviceSize defragmentationBytesPerFrame = 16ull * 1024 * 1024;
+
 const std::vector<const char*> validationLayers = {
   "VK_LAYER_KHRONOS_validation",
 };
@@ -78,40 +160,97 @@ struct UniformBufferObject {
   alignas(16) glm::mat4 proj;
 };
 
-struct Vertex {
-  glm::vec3 pos;
-  glm::vec3 color;
-  glm::vec2 texCoord;
-
-  static VkVertexInputBindingDescription getBindingDescription() {
-    VkVertexInputBindingDescription bindingDrescription{};
-    bindingDrescription.binding = 0;
-    bindingDrescription.stride = sizeof(Vertex);
-    bindingDrescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+// The model's vertex and index buffers, with what drawing them takes.
+struct ModelBuffers {
+  VkBuffer positionBuffer;
+  DeviceAllocation positionBufferMemory;
+  VkDeviceSize positionBufferSize = 0;
+  VkBuffer attributeBuffer;
+  DeviceAllocation attributeBufferMemory;
+  VkDeviceSize attributeBufferSize = 0;
+  VkBuffer indexBuffer;
+  DeviceAllocation indexBufferMemory;
+  VkDeviceSize indexBufferSize = 0;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+  VertexDequantization dequantization{};
+  std::vector<Submesh> submeshes;
+};
 
-    return bindingDrescription;
-  }
+// One incremental defragmentation pass, from the allocator picking blocks
+// to empty until nothing that can be moved is left in them.
+struct DefragmentationPass {
+  uint64_t startFrame;
+  DeviceAllocatorStats before;
+  bool movingModelBuffers = false;
+  bool movingModelTexture = false;
+  uint32_t movedCount = 0;
+  VkDeviceSize movedBytes = 0;
+};
 
-  static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
-    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+struct SampledTexture {
+  VkImage image;
+  DeviceAllocation memory;
+  VkImageView view;
+  // set 1, sampling view; textures are swapped by binding another set, so a
+  // set is never written while a frame may be using it
+  VkDescriptorSet descriptorSet;
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipLevels;
+  ResidentTextureId residency = 0; // 0 for the placeholder, which is not tracked
+};
 
-    attributeDescriptions[0].binding = 0;
-    attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[0].offset = offsetof(Vertex, pos);
+// Commands and staging memory of one upload. Copies are recorded for the
+// transfer queue; the graphics queue then takes ownership of what they wrote
+// and does what only it can, like blitting mip levels.
+struct Upload {
+  VkCommandBuffer transferCommands;
+  VkCommandBuffer graphicsCommands;
+  // staging ring ranges, and buffers for what did not fit the ring
+  std::vector<uint64_t> stagingRingAllocations;
+  std::vector<VkBuffer> stagingBuffers;
+  std::vector<DeviceAllocation> stagingBuffersMemory;
+
+  // signalled by the transfer submit and waited on by the graphics submit,
+  // only with a separate transfer queue
+  VkSemaphore transferDone = VK_NULL_HANDLE;
+  // signalled by the transfer submit, only with a separate transfer queue;
+  // the staging can go once it is
+  VkFence transferFence = VK_NULL_HANDLE;
+  // signalled by the graphics submit
+  VkFence fence = VK_NULL_HANDLE;
+  uint64_t serial; // counts submitted uploads, see RetiredResource
+  // runs once the graphics queue is done with the upload
+  std::function<void()> onComplete;
+};
 
-    attributeDescriptions[1].binding = 0;
-    attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[1].offset = offsetof(Vertex, color);
+// A resource replaced while submitted frames or uploads may still use it,
+// destroyed once they are done rather than waiting for the device to idle.
+struct RetiredResource {
+  uint32_t framesLeft; // frame fences to wait for
+  uint64_t lastUpload; // serial of the newest upload when it was retired
+  std::function<void()> destroy;
+};
 
-    attributeDescriptions[2].binding = 0;
-    attributeDescriptions[2].location = 2;
-    attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+// Per-frame constants: one persistently mapped buffer with a region per
+// frame in flight, handed out front to back by pushUniforms and bound with
+// the dynamic offsets it returns. A region is reused once its frame's fence
+// has signalled, like the frame's command buffer.
+struct UniformArena {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  DeviceAllocation memory;
+  VkDeviceSize alignment; // minUniformBufferOffsetAlignment
+  VkDeviceSize regionSize;
+  // the current frame's region
+  VkDeviceSize head;
+  VkDeviceSize regionEnd;
+};
 
-    return attributeDescriptions;
-  }
+// Where stageUpload put an upload's data.
+struct StagingRegion {
+  VkBuffer buffer;
+  VkDeviceSize offset;
 };
 
 std::vector<Vertex> vertices = {
@@ -126,7 +265,7 @@ std::vector<Vertex> vertices = {
   {{-0.5f, 0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}},
 };
 
-std::vector<uint16_t> indices = {
+std::vector<uint32_t> indices = {
   0, 1, 2, 2, 3, 0,
   4, 5, 6, 6, 7, 4,
 };
@@ -145,34 +284,54 @@ private:
   VkDebugUtilsMessengerEXT debugMessenger;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
   VkDevice device;
+  // every buffer and image gets its memory from here
+  std::optional<DeviceAllocator> deviceAllocator;
   VkQueue graphicsQueue;
+  VkQueue transferQueue; // the graphics queue without a transfer-only family
+  uint32_t graphicsQueueFamily;
+  uint32_t transferQueueFamily;
   VkSurfaceKHR surface;
   VkQueue presentQueue;
   VkSwapchainKHR swapChain;
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
   VkRenderPass renderPass;
-  VkDescriptorSetLayout descriptorSetLayout;
+  VkDescriptorSetLayout descriptorSetLayout; // set 0, the uniform arena
+  VkDescriptorSetLayout textureSetLayout; // set 1, see SampledTexture
   VkPipelineLayout pipelineLayout;
-  VkPipeline graphicsPipeline;
+  VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+  VkPipeline depthPrepassPipeline = VK_NULL_HANDLE;
+  // every pipeline is created through it; seeded from pipelineCachePath at
+  // startup and saved back at shutdown
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
   VkCommandPool commandPool;
-  VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  VkBuffer indexBuffer;
-  VkDeviceMemory indexBufferMemory;
+  VkCommandPool transferCommandPool;
+  ModelBuffers modelBuffers;
+  uint64_t modelBuffersGeneration = 0; // bumped when a new model replaces them
   VkDescriptorPool descriptorPool;
 
-  VkImage textureImage;
-  VkDeviceMemory textureImageMemory;
-  VkImageView textureImageView;
-
+  SampledTexture modelTexture;
+  SampledTexture placeholderTexture; // sampled while the model texture is not resident
   VkSampler textureSampler;
 
+  // uploads the GPU may still be working on, oldest first
+  std::vector<Upload> pendingUploads;
+  uint64_t uploadsSubmitted = 0;
+
+  std::vector<RetiredResource> retiredResources;
+
+  VkBuffer stagingRingBuffer;
+  DeviceAllocation stagingRingMemory;
+  RingAllocator stagingRing{ stagingRingSize };
+  VkDeviceSize stagingAlignment;
+  uint32_t stagingRingWaits = 0;
+  uint32_t dedicatedStagingBuffers = 0;
+
   VkImage depthImage;
-  VkDeviceMemory depthImageMemory;
+  DeviceAllocation depthImageMemory;
   VkImageView depthImageView;
 
-  std::vector<VkDescriptorSet> descriptorSets;
+  VkDescriptorSet uniformDescriptorSet;
   std::vector<VkFramebuffer> swapChainFramebuffers;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
@@ -181,28 +340,36 @@ private:
   std::vector<VkSemaphore> renderFinishedSemaphores;
   std::vector<VkFence> inFlightFences;
   std::vector<VkFence> imagesInFlight;
-  std::vector<VkBuffer> uniformBuffers;
-  std::vector<VkDeviceMemory> uniformBuffersMemory;
+  UniformArena uniformArena;
 
   size_t currentFrame = 0;
   bool frameBufferResized = false;
 
-  static std::vector<char> readFile(const std::string& filename) {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-      throw std::runtime_error("failed to open file!");
-    }
-
-    size_t fileSize = (size_t)file.tellg();
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-    return buffer;
-  }
+  // pipelines compile in the background; frames are drawn without the model
+  // until they are all there
+  std::optional<PipelineCompiler> pipelineCompiler;
+  std::future<CompiledPipeline> pendingGraphicsPipeline;
+  std::future<CompiledPipeline> pendingDepthPrepassPipeline;
+  std::chrono::high_resolution_clock::time_point pipelineRequestTime;
+  uint32_t framesWithoutPipelines = 0;
+
+  // the model and texture stream in from the start of initVulkan; until they
+  // arrive the built-in quads are drawn with a placeholder texture
+  TextureCache textureCache{ textureCacheDirectory, textureCacheMaxBytes, true };
+  AssetStreamer assetStreamer;
+  AssetId modelAsset = 0; // 0 when nothing is in flight
+  AssetId textureAsset = 0;
+  std::optional<glm::vec3> streamingEye; // what priorities were last worked out from
+
+  // the model texture's residency: where it is reloaded from, and which
+  // level of the full chain modelTexture starts at
+  TextureResidency textureResidency{ textureBudgetBytes, textureIdleFrames };
+  ResidentTextureId modelTextureResidency = 0; // 0 for the placeholder
+  std::string modelTexturePath;
+  uint32_t modelTextureFirstLevel = 0;
+  uint64_t frameNumber = 0;
+  std::optional<DefragmentationPass> defragmentation;
+  std::chrono::high_resolution_clock::time_point initStartTime;
 
   VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
     for (const auto& availableFormat : availableFormats) 
@@ -289,6 +456,8 @@ private:
   struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // a family that can do neither graphics nor compute, if there is one
+    std::optional<uint32_t> transferFamily;
 
     bool isComplete() {
       return graphicsFamily.has_value() && presentFamily.has_value();
@@ -323,6 +492,16 @@ private:
       i++;
     }
 
+    // transfer-only families are backed by the copy engines, which run
+    // alongside graphics work
+    for (uint32_t family = 0; family < queueFamilyCount; family++) {
+      VkQueueFlags flags = queueFamilies[family].queueFlags;
+      if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+        indices.transferFamily = family;
+        break;
+      }
+    }
+
     return indices;
   }
 
@@ -419,7 +598,8 @@ private:
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // 1.1 for vkGetPhysicalDeviceMemoryProperties2, which reports memory budgets
+    appInfo.apiVersion = VK_API_VERSION_1_1;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -524,13 +704,40 @@ private:
     return requiredExtensions.empty();
   }
 
+  bool hasDeviceExtension(VkPhysicalDevice device, const char* name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+      if (strcmp(extension.extensionName, name) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Whether the device reports how much of each heap this process may use,
+  // which the allocator keeps new blocks within.
+  bool supportsMemoryBudget(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    return properties.apiVersion >= VK_API_VERSION_1_1
+      && hasDeviceExtension(device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
   void createLogicalDevice() {
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    graphicsQueueFamily = indices.graphicsFamily.value();
+    transferQueueFamily = indices.transferFamily.value_or(graphicsQueueFamily);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {
       indices.graphicsFamily.value(),
-      indices.presentFamily.value()
+      indices.presentFamily.value(),
+      transferQueueFamily
     };
 
     float queuePriority = 1.0f;
@@ -554,8 +761,13 @@ private:
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    std::vector<const char*> enabledExtensions = deviceExtensions;
+    if (supportsMemoryBudget(physicalDevice)) {
+      enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     if (enableValidationLayers) {
       createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -570,6 +782,13 @@ private:
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    vkGetDeviceQueue(device, transferQueueFamily, 0, &transferQueue);
+
+    if (transferQueueFamily != graphicsQueueFamily) {
+      std::cout << "uploading on transfer queue family " << transferQueueFamily << std::endl;
+    } else {
+      std::cout << "no transfer-only queue family, uploading on the graphics queue" << std::endl;
+    }
   }
 
   void createSurface() {
@@ -641,81 +860,36 @@ void createImageViews() {
     swapChainImageViews[i] = createImageView(
       swapChainImages[i],
       swapChainImageFormat,
-      VK_IMAGE_ASPECT_COLOR_BIT);
-  }
-}
-
-VkShaderModule createShaderModule(const std::vector<char>& code) {
-  VkShaderModuleCreateInfo createInfo{};
-  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  createInfo.codeSize = code.size();
-  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-  VkShaderModule shaderModule;
-  if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create shader module!");
+      VK_IMAGE_ASPECT_COLOR_BIT,
+      1);
   }
-
-  return shaderModule;
 }
 
+// Creates the pipeline layout and hands the pipelines to the compiler.
+// They arrive in takeCompiledPipelines; until then recordCommandBuffer
+// records frames that only clear.
 void createGraphicsPipeline() {
-  auto vertShaderCode = readFile("shaders/shader.vert.spv");
-  auto fragShaderCode = readFile("shaders/shader.frag.spv");
-
-  VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-  VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-  VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-  vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-  vertShaderStageInfo.module = vertShaderModule;
-  vertShaderStageInfo.pName = "main";
-
-  VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-  fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  fragShaderStageInfo.module = fragShaderModule;
-  fragShaderStageInfo.pName = "main";
-
-  VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-
-  auto bindingDrescription = Vertex::getBindingDescription();
-  auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
-  vertexInputInfo.vertexAttributeDescriptionCount = 
-  static_cast<uint32_t>(attributeDescriptions.size());
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDrescription;
-  vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+  GraphicsPipelineDescription description{};
+  description.name = "main";
+
+  description.stages.push_back({
+    VK_SHADER_STAGE_VERTEX_BIT,
+    loadShader(
+      vertexFormat == VertexFormat::Float32
+        ? "shader.vert"
+        : "shader_quantized.vert") });
+  description.stages.push_back({ VK_SHADER_STAGE_FRAGMENT_BIT, loadShader("shader.frag") });
+
+  VertexInputLayout vertexLayout = vertexInputLayout(vertexFormat);
+  description.vertexBindings.assign(vertexLayout.bindings.begin(), vertexLayout.bindings.end());
+  description.vertexAttributes.assign(vertexLayout.attributes.begin(), vertexLayout.attributes.end());
+
+  VkPipelineInputAssemblyStateCreateInfo& inputAssembly = description.inputAssembly;
   inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
   inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float)swapChainExtent.width;
-  viewport.height = (float)swapChainExtent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-
-  VkRect2D scissor{};
-  scissor.offset = {0,0};
-  scissor.extent = swapChainExtent;
-
-  VkPipelineViewportStateCreateInfo viewportState{};
-  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-  viewportState.viewportCount = 1;
-  viewportState.pViewports = &viewport;
-  viewportState.scissorCount = 1;
-  viewportState.pScissors = &scissor;
-
-  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  VkPipelineRasterizationStateCreateInfo& rasterizer = description.rasterizer;
   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
   rasterizer.depthClampEnable = VK_FALSE;
   rasterizer.rasterizerDiscardEnable = VK_FALSE;
@@ -728,7 +902,7 @@ void createGraphicsPipeline() {
   rasterizer.depthBiasClamp = 0.0f;
   rasterizer.depthBiasSlopeFactor = 0.0f;
 
-  VkPipelineMultisampleStateCreateInfo multisampling{};
+  VkPipelineMultisampleStateCreateInfo& multisampling = description.multisampling;
   multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
   multisampling.sampleShadingEnable = VK_FALSE;
   multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
@@ -750,41 +924,40 @@ void createGraphicsPipeline() {
   colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
   colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
   colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+  description.colorBlendAttachments = { colorBlendAttachment };
 
-  VkPipelineColorBlendStateCreateInfo colorBlending{};
+  VkPipelineColorBlendStateCreateInfo& colorBlending = description.colorBlending;
   colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
   colorBlending.logicOpEnable = VK_FALSE;
   colorBlending.logicOp = VK_LOGIC_OP_COPY;
-  colorBlending.attachmentCount = 1;
-  colorBlending.pAttachments = &colorBlendAttachment;
   colorBlending.blendConstants[0] = 0.0f;
   colorBlending.blendConstants[1] = 0.0f;
   colorBlending.blendConstants[2] = 0.0f;
   colorBlending.blendConstants[3] = 0.0f;
 
-  VkDynamicState dynamicStates[] = {
-    VK_DYNAMIC_STATE_VIEWPORT,
-    VK_DYNAMIC_STATE_LINE_WIDTH,
-  };
-
-  VkPipelineDynamicStateCreateInfo dynamicState{};
-  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-  dynamicState.dynamicStateCount = 2;
-  dynamicState.pDynamicStates = dynamicStates;
-
-
   VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 1;
-  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, textureSetLayout };
+  pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+  pipelineLayoutInfo.pSetLayouts = setLayouts.data();
   pipelineLayoutInfo.pushConstantRangeCount = 0;
   pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
+  VkPushConstantRange dequantizationRange{};
+  dequantizationRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  dequantizationRange.offset = 0;
+  dequantizationRange.size = sizeof(VertexDequantization);
+
+  if (vertexFormat != VertexFormat::Float32) {
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &dequantizationRange;
+  }
+
   if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
     throw std::runtime_error("failed to create pipeline layout!");
   }
 
-  VkPipelineDepthStencilStateCreateInfo depthStencil{};
+  VkPipelineDepthStencilStateCreateInfo& depthStencil = description.depthStencil;
   depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
   depthStencil.depthTestEnable = VK_TRUE; 
   depthStencil.depthWriteEnable = VK_TRUE;
@@ -796,36 +969,130 @@ void createGraphicsPipeline() {
   depthStencil.front = {};
   depthStencil.back = {};
 
-  VkGraphicsPipelineCreateInfo pipelineInfo{};
-  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipelineInfo.stageCount = 2;
-  pipelineInfo.pStages = shaderStages;
-  pipelineInfo.pVertexInputState = &vertexInputInfo;
-  pipelineInfo.pInputAssemblyState = &inputAssembly;
-  pipelineInfo.pViewportState = &viewportState;
-  pipelineInfo.pRasterizationState = &rasterizer;
-  pipelineInfo.pMultisampleState = &multisampling;
-  pipelineInfo.pDepthStencilState = &depthStencil;
-  pipelineInfo.pColorBlendState = &colorBlending;
-  pipelineInfo.pDynamicState = nullptr;
-  pipelineInfo.layout = pipelineLayout;
-  pipelineInfo.renderPass = renderPass;
-  pipelineInfo.subpass = 0;
-  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-  pipelineInfo.basePipelineIndex = -1;
-
-  if (vkCreateGraphicsPipelines(
-    device, 
-    VK_NULL_HANDLE, 
-    1, 
-    &pipelineInfo, 
-    nullptr, 
-    &graphicsPipeline) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create graphics pipeline!");
-}
-
-vkDestroyShaderModule(device, fragShaderModule, nullptr);
-vkDestroyShaderModule(device, vertShaderModule, nullptr);
+  // the prepass already wrote the final depth, only shade what matches it
+  if (depthPrepass) {
+    depthStencil.depthWriteEnable = VK_FALSE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+  }
+
+  description.layout = pipelineLayout;
+  description.renderPass = renderPass;
+  description.subpass = 0;
+
+  pipelineRequestTime = std::chrono::high_resolution_clock::now();
+
+  if (!depthPrepass) {
+    pendingGraphicsPipeline = pipelineCompiler->compile(std::move(description));
+    return;
+  }
+
+  // same state, but only the vertex stage, only the position stream, depth
+  // writes on and color writes off
+  GraphicsPipelineDescription depthDescription = description;
+  depthDescription.name = "depth prepass";
+  depthDescription.stages = { {
+    VK_SHADER_STAGE_VERTEX_BIT,
+    loadShader(
+      vertexFormat == VertexFormat::Float32
+        ? "depth.vert"
+        : "depth_quantized.vert") } };
+  depthDescription.vertexBindings.resize(1);
+  depthDescription.vertexAttributes.resize(1);
+
+  depthDescription.depthStencil.depthWriteEnable = VK_TRUE;
+  depthDescription.depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+  depthDescription.colorBlendAttachments[0].blendEnable = VK_FALSE;
+  depthDescription.colorBlendAttachments[0].colorWriteMask = 0;
+
+  // the prepass is what the main pass depth tests against, compile it first
+  pendingDepthPrepassPipeline = pipelineCompiler->compile(std::move(depthDescription));
+  pendingGraphicsPipeline = pipelineCompiler->compile(std::move(description));
+}
+
+// Whether recordCommandBuffer can record the model draws.
+bool renderPipelinesReady() const {
+  return graphicsPipeline != VK_NULL_HANDLE
+    && (!depthPrepass || depthPrepassPipeline != VK_NULL_HANDLE);
+}
+
+// Picks up pipelines the compiler finished since the last frame, without
+// waiting for the rest. Returns whether any arrived.
+bool takeCompiledPipelines() {
+  bool arrived = takeCompiledPipeline(pendingGraphicsPipeline, graphicsPipeline);
+  arrived = takeCompiledPipeline(pendingDepthPrepassPipeline, depthPrepassPipeline) || arrived;
+
+  if (arrived && renderPipelinesReady()) {
+    auto readyTime = std::chrono::high_resolution_clock::now();
+    PipelineCompilerStats stats = pipelineCompiler->stats();
+    std::cout << "pipelines ready after "
+      << std::chrono::duration<float, std::chrono::milliseconds::period>(readyTime - pipelineRequestTime).count()
+      << " ms, " << framesWithoutPipelines << " frames drawn without the model; compiled "
+      << stats.completed << " pipelines in " << stats.totalCompileSeconds * 1000.0f << " ms (max "
+      << stats.maxCompileSeconds * 1000.0f << " ms), " << stats.queued << " queued, "
+      << stats.compiling << " compiling" << std::endl;
+    framesWithoutPipelines = 0;
+  }
+
+  return arrived;
+}
+
+bool takeCompiledPipeline(std::future<CompiledPipeline>& pending, VkPipeline& pipeline) {
+  if (!pending.valid() || pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    return false;
+  }
+
+  pipeline = pending.get().pipeline;
+  return true;
+}
+
+// Seeds the pipeline cache with what the last run saved, if it was saved by
+// this device and driver.
+void createPipelineCache() {
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  std::vector<char> initialData;
+  try {
+    initialData = readPipelineCache(pipelineCachePath, properties);
+  } catch (const std::exception& e) {
+    std::cout << "WARNING: failed to read pipeline cache: " << e.what() << std::endl;
+  }
+  std::cout << (initialData.empty() ? "cold" : "warm") << " pipeline cache, "
+    << initialData.size() / 1024 << " KiB" << std::endl;
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = initialData.size();
+  cacheInfo.pInitialData = initialData.data();
+
+  if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+}
+
+void savePipelineCache() {
+  size_t dataSize = 0;
+  if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+    std::cout << "WARNING: failed to get pipeline cache data" << std::endl;
+    return;
+  }
+
+  std::vector<char> data(dataSize);
+  if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+    std::cout << "WARNING: failed to get pipeline cache data" << std::endl;
+    return;
+  }
+  data.resize(dataSize);
+
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  try {
+    writePipelineCache(pipelineCachePath, properties, data);
+  } catch (const std::exception& e) {
+    std::cout << "WARNING: failed to write pipeline cache: " << e.what() << std::endl;
+  }
 }
 
 void createRenderPass() {
@@ -922,15 +1189,39 @@ void createCommandPool() {
   VkCommandPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-  poolInfo.flags = 0;
+  // frame command buffers are reset and recorded again every frame
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
   if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
+
+  VkCommandPoolCreateInfo transferPoolInfo{};
+  transferPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  transferPoolInfo.queueFamilyIndex = transferQueueFamily;
+  transferPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  if (vkCreateCommandPool(device, &transferPoolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create transfer command pool!");
+  }
+}
+
+void recordModelDraws(VkCommandBuffer commandBuffer) {
+  for (const auto& submesh : modelBuffers.submeshes) {
+    vkCmdDrawIndexed(
+      commandBuffer,
+      submesh.indexCount,
+      1,
+      submesh.firstIndex,
+      static_cast<int32_t>(submesh.vertexOffset),
+      0);
+  }
 }
 
+// One command buffer per frame in flight, recorded by drawFrame once the
+// frame's previous use of it is done.
 void createCommandBuffers() {
-  commandBuffers.resize(swapChainFramebuffers.size());
+  commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -941,60 +1232,105 @@ void createCommandBuffers() {
   if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
     throw std::runtime_error("failed to allocate command buffers!");
   }
+}
 
-  for (size_t i = 0; i < commandBuffers.size(); i++) {
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = 0;
-    beginInfo.pInheritanceInfo = nullptr;
+// Records drawing the current model, texture and pipelines into imageIndex's
+// framebuffer, with the frame's uniforms at uniformOffset in the arena.
+void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t uniformOffset) {
+  if (vkResetCommandBuffer(commandBuffer, 0) != VK_SUCCESS) {
+    throw std::runtime_error("failed to reset command buffer!");
+  }
 
-    if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-      throw std::runtime_error("failed to begin recording command buffer!");
-    }
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  beginInfo.pInheritanceInfo = nullptr;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording command buffer!");
+  }
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[i];
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
+  VkRenderPassBeginInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass = renderPass;
+  renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+  renderPassInfo.renderArea.offset = {0, 0};
+  renderPassInfo.renderArea.extent = swapChainExtent;
 
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-    clearValues[1].depthStencil = { 1.0f, 0 };
+  std::array<VkClearValue, 2> clearValues{};
+  clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+  clearValues[1].depthStencil = { 1.0f, 0 };
 
-    renderPassInfo.clearValueCount = static_cast<size_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
+  renderPassInfo.clearValueCount = static_cast<size_t>(clearValues.size());
+  renderPassInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+  VkViewport viewport{};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = (float)swapChainExtent.width;
+  viewport.height = (float)swapChainExtent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-    VkBuffer vertexBuffers[] = { vertexBuffer };
-    VkDeviceSize offsets[] = { 0 };
+  VkRect2D scissor{};
+  scissor.offset = {0, 0};
+  scissor.extent = swapChainExtent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-    vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-    vkCmdBindDescriptorSets(
-      commandBuffers[i],
-      VK_PIPELINE_BIND_POINT_GRAPHICS,
+  // descriptor sets and push constants stay bound across both pipelines,
+  // which share the layout
+  if (vertexFormat != VertexFormat::Float32) {
+    vkCmdPushConstants(
+      commandBuffer,
       pipelineLayout,
+      VK_SHADER_STAGE_VERTEX_BIT,
       0,
-      1,
-      &descriptorSets[i],
-      0,
-      nullptr);
+      sizeof(VertexDequantization),
+      &modelBuffers.dequantization);
+  }
 
-    vkCmdDrawIndexed(
-      commandBuffers[i],
-      static_cast<uint32_t>(indices.size()),
-      1, 0, 0, 0);
+  VkBuffer vertexBuffers[] = { modelBuffers.positionBuffer, modelBuffers.attributeBuffer };
+  VkDeviceSize offsets[] = { 0, 0 };
+
+  vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+  vkCmdBindIndexBuffer(commandBuffer, modelBuffers.indexBuffer, 0, modelBuffers.indexType);
+  std::array<VkDescriptorSet, 2> sets = { uniformDescriptorSet, modelTexture.descriptorSet };
+  vkCmdBindDescriptorSets(
+    commandBuffer,
+    VK_PIPELINE_BIND_POINT_GRAPHICS,
+    pipelineLayout,
+    0,
+    static_cast<uint32_t>(sets.size()),
+    sets.data(),
+    1,
+    &uniformOffset);
+
+  // until the compiler delivers, the frame is only cleared rather than
+  // stalling on the pipelines
+  if (renderPipelinesReady()) {
+    if (depthPrepass) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrepassPipeline);
+      recordModelDraws(commandBuffer);
+    }
 
-    vkCmdEndRenderPass(commandBuffers[i]);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    recordModelDraws(commandBuffer);
 
-    if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to record command buffer!");
+    // only a texture this frame samples counts as used, so an evicted one
+    // drawn as the placeholder stays evicted until it is needed again
+    if (modelTexture.residency != 0) {
+      textureResidency.used(modelTexture.residency, frameNumber);
     }
   }
+
+  vkCmdEndRenderPass(commandBuffer);
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record command buffer!");
+  }
 }
 
 void createSyncObjects() {
@@ -1024,7 +1360,19 @@ void createSyncObjects() {
 }
 
 void drawFrame() {
+  updateStreamingPriorities(cameraPosition);
+  assetStreamer.deliverCompleted();
+  reclaimUploads();
+  updateTextureResidency();
+  updateDefragmentation();
+
+  takeCompiledPipelines();
+  if (!renderPipelinesReady()) {
+    framesWithoutPipelines++;
+  }
+
   vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+  releaseRetired();
 
   uint32_t imageIndex;
   VkResult result = vkAcquireNextImageKHR(
@@ -1047,7 +1395,9 @@ void drawFrame() {
   }
   imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-  updateUniformBuffer(imageIndex);
+  beginUniformFrame(currentFrame);
+  uint32_t uniformOffset = updateUniformBuffer();
+  recordCommandBuffer(commandBuffers[currentFrame], imageIndex, uniformOffset);
 
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1057,7 +1407,7 @@ void drawFrame() {
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
   submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+  submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
   VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
@@ -1088,6 +1438,9 @@ void drawFrame() {
   currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
+// Rebuilds what depends on the swapchain images and their extent. The
+// render pass and pipelines only depend on the surface format, so those are
+// kept unless a new swapchain changes it.
 void recreateSwapChain() {
   int width = 0, height = 0;
   glfwGetFramebufferSize(window, &width, &height);
@@ -1096,58 +1449,88 @@ void recreateSwapChain() {
     glfwWaitEvents();
   }
 
+  auto startTime = std::chrono::high_resolution_clock::now();
+
   vkDeviceWaitIdle(device);
 
+  VkFormat oldImageFormat = swapChainImageFormat;
+
   cleanupSwapChain();
 
   createSwapChain();
   createImageViews();
-  createRenderPass();
-  createGraphicsPipeline();
+
+  if (swapChainImageFormat != oldImageFormat) {
+    cleanupRenderPipelines();
+    createRenderPass();
+    createGraphicsPipeline();
+  }
+
   createDepthResources();
   createFramebuffers();
-  createUniformBuffers();
-  createDescriptorPool();
-  createDescriptorSets();
-  createCommandBuffers();
 
-  imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+  imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+  std::cout << "recreated the swapchain at " << swapChainExtent.width << "x" << swapChainExtent.height << " in "
+    << std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count() << " ms"
+    << std::endl;
 }
 
+// Everything sized to the swapchain extent.
 void cleanupSwapChain() {
   for (auto framebuffer : swapChainFramebuffers) {
     vkDestroyFramebuffer(device, framebuffer, nullptr);
   }
-  vkFreeCommandBuffers(
-    device,
-    commandPool,
-    static_cast<uint32_t>(commandBuffers.size()),
-    commandBuffers.data());
 
-  vkDestroyPipeline(device, graphicsPipeline, nullptr);
-  vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-  vkDestroyRenderPass(device, renderPass, nullptr);
+  vkDestroyImageView(device, depthImageView, nullptr);
+  vkDestroyImage(device, depthImage, nullptr);
+  deviceAllocator->free(depthImageMemory);
 
   for (auto imageView : swapChainImageViews) {
     vkDestroyImageView(device, imageView, nullptr);
   }
 
   vkDestroySwapchainKHR(device, swapChain, nullptr);
+}
 
-  for (size_t i = 0; i < swapChainImages.size(); i++) {
-    vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-    vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+void freeCommandBuffers() {
+  vkFreeCommandBuffers(
+    device,
+    commandPool,
+    static_cast<uint32_t>(commandBuffers.size()),
+    commandBuffers.data());
+}
+
+void cleanupRenderPipelines() {
+  // pipelines still compiling are waited for, they reference the layout and
+  // render pass destroyed here
+  if (pendingGraphicsPipeline.valid()) {
+    graphicsPipeline = pendingGraphicsPipeline.get().pipeline;
+  }
+  if (pendingDepthPrepassPipeline.valid()) {
+    depthPrepassPipeline = pendingDepthPrepassPipeline.get().pipeline;
   }
 
-  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  if (graphicsPipeline != VK_NULL_HANDLE) {
+    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    graphicsPipeline = VK_NULL_HANDLE;
+  }
+  if (depthPrepassPipeline != VK_NULL_HANDLE) {
+    vkDestroyPipeline(device, depthPrepassPipeline, nullptr);
+    depthPrepassPipeline = VK_NULL_HANDLE;
+  }
+  vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+  vkDestroyRenderPass(device, renderPass, nullptr);
 }
 
 void createBuffer(
   VkDeviceSize size,
   VkBufferUsageFlags usage,
-  VkMemoryPropertyFlags properties,
+  MemoryUsage memoryUsage,
   VkBuffer& buffer,
-  VkDeviceMemory& bufferMemory) 
+  DeviceAllocation& bufferMemory,
+  bool movable = false)
 {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1162,131 +1545,239 @@ void createBuffer(
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = 
-  findMemoryType(memRequirements.memoryTypeBits, properties);
+  bufferMemory = deviceAllocator->allocate(memRequirements, memoryUsage, true, movable);
 
-  if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate buffer memory!");
+  vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
+}
+
+// modelPath as the upload path takes it, either mapped from the binary mesh
+// cache or imported; the log is printed when the model is picked up. Either
+// way it is ready to copy into staging as it is, so loading does all the
+// work on the decode thread and the render thread only uploads.
+struct LoadedModel {
+  PackedMesh mesh; // indices only, the vertices are in vertices
+  UploadVertices vertices;
+  std::optional<MeshCache> cache;
+  std::string log;
+};
+
+// Runs on a streaming thread, so it only reads the settings above. file is
+// the binary cache when fromCache and the obj otherwise, as the I/O thread
+// mapped it.
+LoadedModel loadModel(MappedFile&& file, bool fromCache) {
+  LoadedModel loaded;
+  std::ostringstream log;
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  if (fromCache) {
+    loaded.cache = MeshCache::open(modelPath, std::move(file));
   }
 
-  vkBindBufferMemory(device, buffer, bufferMemory, 0);
-}
+  // a cache written under the other policy or vertex format is rebuilt
+  if (loaded.cache) {
+    bool split = loaded.cache->header().submeshCount > 1;
+    bool wide = loaded.cache->header().indexSize == 4;
+    if ((indexWidthPolicy == IndexWidthPolicy::Split16 && wide)
+      || (indexWidthPolicy == IndexWidthPolicy::Widen32 && split)
+      || loaded.cache->vertexFormat() != vertexFormat) {
+      loaded.cache.reset();
+    }
+  }
 
-void createVertexBuffer() {
-  VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+  if (loaded.cache) {
+    auto endTime = std::chrono::high_resolution_clock::now();
+    float seconds =
+      std::chrono::duration<float, std::chrono::seconds::period>(endTime - startTime).count();
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  createBuffer(
-    bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    stagingBuffer,
-    stagingBufferMemory);
+    log << "model ready in " << seconds * 1000.0f << " ms (binary cache "
+      << meshCachePath(modelPath) << ")" << std::endl;
+    loaded.log = log.str();
+    return loaded;
+  }
 
-  void* data;
-  vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+  // a stale cache leaves the obj to be read here
+  ObjMesh obj = fromCache ? loadObjParallel(modelPath) : parseObjParallel(file.data(), file.size());
 
-  memcpy(data, vertices.data(), (size_t)bufferSize);
+  auto parsedTime = std::chrono::high_resolution_clock::now();
 
-  vkUnmapMemory(device, stagingBufferMemory);
+  MeshData mesh = buildMesh(obj);
 
-  createBuffer(
-    bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    vertexBuffer,
-    vertexBufferMemory);
+  auto endTime = std::chrono::high_resolution_clock::now();
 
-  copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+  if (optimizeModel) {
+    VertexCacheStats before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeMesh(mesh);
+    VertexCacheStats after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
 
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
+    auto optimizedTime = std::chrono::high_resolution_clock::now();
+    float optimizeSeconds =
+      std::chrono::duration<float, std::chrono::seconds::period>(optimizedTime - endTime).count();
 
-void createIndexBuffer() {
-  VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    log << "optimized model in " << optimizeSeconds * 1000.0f << " ms: ACMR "
+      << before.acmr << " -> " << after.acmr << ", ATVR "
+      << before.atvr << " -> " << after.atvr << std::endl;
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  createBuffer(
-    bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    stagingBuffer,
-    stagingBufferMemory);
+    endTime = optimizedTime;
+  }
 
-  void* data;
-  vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+  size_t cornerCount = mesh.indices.size();
+  size_t uniqueVertexCount = mesh.vertices.size();
+  loaded.mesh = packIndices(std::move(mesh), indexWidthPolicy);
+
+  // quantized once here; the cache keeps the result
+  QuantizationError error;
+  loaded.vertices = prepareUploadVertices(loaded.mesh.vertices.data(), loaded.mesh.vertices.size(), vertexFormat, &error);
+  if (vertexFormat != VertexFormat::Float32) {
+    log << "quantized " << loaded.vertices.vertexCount << " vertices from "
+      << loaded.mesh.vertices.size() * sizeof(Vertex) / 1024 << " KB to "
+      << (loaded.vertices.streams.positions.size() + loaded.vertices.streams.attributes.size()) / 1024
+      << " KB: max position error " << error.maxPositionError << " (" << error.relativePositionError * 100.0f
+      << "% of bounds), max uv error " << error.maxTexCoordError
+      << ", max color error " << error.maxColorError << std::endl;
+  }
 
-  memcpy(data, indices.data(), (size_t)bufferSize);
+  try {
+    writeMeshCache(modelPath, loaded.mesh, loaded.vertices);
+  } catch (const std::exception& e) {
+    log << "WARNING: failed to write mesh cache: " << e.what() << std::endl;
+  }
+  loaded.mesh.vertices = std::vector<Vertex>();
+
+  float parseSeconds =
+    std::chrono::duration<float, std::chrono::seconds::period>(parsedTime - startTime).count();
+  float dedupSeconds =
+    std::chrono::duration<float, std::chrono::seconds::period>(endTime - parsedTime).count();
+  float megabytes = std::filesystem::file_size(modelPath) / (1024.0f * 1024.0f);
+  float millionFaces = cornerCount / 3 / 1000000.0f;
+
+  log << "loaded " << modelPath << ": " << megabytes << " MB in " << parseSeconds * 1000.0f
+    << " ms (" << megabytes / parseSeconds << " MB/s)" << std::endl;
+  log << "deduplicated " << cornerCount << " corners to " << uniqueVertexCount
+    << " vertices (" << cornerCount / (float)uniqueVertexCount << "x) in "
+    << dedupSeconds * 1000.0f << " ms (" << dedupSeconds * 1000.0f / millionFaces
+    << " ms per million faces)" << std::endl;
+  log << "model ready in " << (parseSeconds + dedupSeconds) * 1000.0f
+    << " ms (parsed obj)" << std::endl;
+  log << "drawing with " << loaded.mesh.indexSize * 8 << "-bit indices in "
+    << loaded.mesh.submeshes.size() << " submeshes" << std::endl;
+
+  loaded.log = log.str();
+  return loaded;
+}
 
-  vkUnmapMemory(device, stagingBufferMemory);
+// Records the upload of data into a new device local buffer, which is ready
+// for vertex input once upload has completed.
+void createDeviceLocalBuffer(
+  Upload& upload,
+  const void* data,
+  VkDeviceSize bufferSize,
+  VkBufferUsageFlags usage,
+  VkBuffer& buffer,
+  DeviceAllocation& bufferMemory)
+{
+  StagingRegion staging = stageUpload(upload, bufferSize, [&](void* mapped) {
+    memcpy(mapped, data, (size_t)bufferSize);
+  });
 
   createBuffer(
     bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    indexBuffer,
-    indexBufferMemory);
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+    MemoryUsage::GpuOnly,
+    buffer,
+    bufferMemory,
+    true);
 
-  copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+  copyBuffer(upload.transferCommands, staging.buffer, staging.offset, buffer, bufferSize);
+  transferBufferOwnership(upload, buffer);
+}
 
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+// The streams are ready to upload as they are, whether from the cache or
+// prepared at import.
+void createVertexBuffer(Upload& upload, const LoadedModel& loaded, ModelBuffers& buffers) {
+  const void* positionData = loaded.vertices.streams.positions.data();
+  VkDeviceSize positionSize = loaded.vertices.streams.positions.size();
+  const void* attributeData = loaded.vertices.streams.attributes.data();
+  VkDeviceSize attributeSize = loaded.vertices.streams.attributes.size();
+  buffers.dequantization = loaded.vertices.dequantization;
+
+  if (loaded.cache) {
+    positionData = loaded.cache->positionData();
+    positionSize = loaded.cache->positionDataSize();
+    attributeData = loaded.cache->attributeData();
+    attributeSize = loaded.cache->attributeDataSize();
+    buffers.dequantization = loaded.cache->header().dequantization;
+  }
+
+  createDeviceLocalBuffer(
+    upload,
+    positionData,
+    positionSize,
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    buffers.positionBuffer,
+    buffers.positionBufferMemory);
+  buffers.positionBufferSize = positionSize;
+  createDeviceLocalBuffer(
+    upload,
+    attributeData,
+    attributeSize,
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    buffers.attributeBuffer,
+    buffers.attributeBufferMemory);
+  buffers.attributeBufferSize = attributeSize;
 }
 
-void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-  auto commandBuffer = beginSingleTimeCommands();
+void createIndexBuffer(Upload& upload, const LoadedModel& loaded, ModelBuffers& buffers) {
+  const void* indexData = loaded.mesh.indexData.data();
+  VkDeviceSize bufferSize = loaded.mesh.indexData.size();
+  uint32_t indexSize = loaded.mesh.indexSize;
+  buffers.submeshes = loaded.mesh.submeshes;
+
+  if (loaded.cache) {
+    indexData = loaded.cache->indexData();
+    bufferSize = loaded.cache->indexDataSize();
+    indexSize = loaded.cache->header().indexSize;
+    buffers.submeshes = loaded.cache->submeshes();
+  }
+
+  buffers.indexType = indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+  createDeviceLocalBuffer(
+    upload,
+    indexData,
+    bufferSize,
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+    buffers.indexBuffer,
+    buffers.indexBufferMemory);
+  buffers.indexBufferSize = bufferSize;
+}
 
+void copyBuffer(
+  VkCommandBuffer commandBuffer,
+  VkBuffer srcBuffer,
+  VkDeviceSize srcOffset,
+  VkBuffer dstBuffer,
+  VkDeviceSize size)
+{
   VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0;
+  copyRegion.srcOffset = srcOffset;
   copyRegion.dstOffset = 0;
   copyRegion.size = size;
   vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-  endSingleTimeCommands(commandBuffer);
-}
-
-uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties memProperties;
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-    if (typeFilter & (1 << i) 
-      && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-    {
-      return i;
-    }
-  }
-
-  throw std::runtime_error("failed to find suitable memory type!");
 }
 
 void createDescriptorSetLayout() {
   VkDescriptorSetLayoutBinding uboLayoutBinding{};
   uboLayoutBinding.binding = 0;
   uboLayoutBinding.descriptorCount = 1;
-  uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   uboLayoutBinding.pImmutableSamplers = nullptr;
   uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-  VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-  samplerLayoutBinding.binding = 1;
-  samplerLayoutBinding.descriptorCount = 1;
-  samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  samplerLayoutBinding.pImmutableSamplers = nullptr;
-  samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-  std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
-
   VkDescriptorSetLayoutCreateInfo layoutInfo{};
   layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  layoutInfo.bindingCount = static_cast<size_t>(bindings.size());
-  layoutInfo.pBindings = bindings.data();
+  layoutInfo.bindingCount = 1;
+  layoutInfo.pBindings = &uboLayoutBinding;
 
   if (vkCreateDescriptorSetLayout(
     device,
@@ -1297,29 +1788,68 @@ void createDescriptorSetLayout() {
     throw std::runtime_error("failed to create descriptor set layout!");
   }
 
+  VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+  samplerLayoutBinding.binding = 0;
+  samplerLayoutBinding.descriptorCount = 1;
+  samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  samplerLayoutBinding.pImmutableSamplers = nullptr;
+  samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  VkDescriptorSetLayoutCreateInfo textureLayoutInfo{};
+  textureLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  textureLayoutInfo.bindingCount = 1;
+  textureLayoutInfo.pBindings = &samplerLayoutBinding;
+
+  if (vkCreateDescriptorSetLayout(device, &textureLayoutInfo, nullptr, &textureSetLayout) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create texture descriptor set layout!");
+  }
+
   VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
   pipelineLayoutInfo.setLayoutCount = 1;
   pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
 }
 
-void createUniformBuffers() {
-  VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+void createUniformArena() {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  uniformArena.alignment = properties.limits.minUniformBufferOffsetAlignment;
 
-  uniformBuffers.resize(swapChainImages.size());
-  uniformBuffersMemory.resize(swapChainImages.size());
+  // regions start aligned, so the first push of a frame lands at the start
+  uniformArena.regionSize =
+    (uniformArenaRegionSize + uniformArena.alignment - 1) / uniformArena.alignment * uniformArena.alignment;
 
-  for (size_t i = 0; i < swapChainImages.size(); i++) {
-    createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      uniformBuffers[i],
-      uniformBuffersMemory[i]);
+  createBuffer(
+    uniformArena.regionSize * MAX_FRAMES_IN_FLIGHT,
+    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+    MemoryUsage::PerFrame,
+    uniformArena.buffer,
+    uniformArena.memory);
+}
+
+// Starts handing out the region of frame in flight frame; its previous use
+// must be done.
+void beginUniformFrame(size_t frame) {
+  uniformArena.head = frame * uniformArena.regionSize;
+  uniformArena.regionEnd = uniformArena.head + uniformArena.regionSize;
+}
+
+// Copies size bytes of data into the frame's region and returns their
+// dynamic offset.
+uint32_t pushUniforms(const void* data, VkDeviceSize size) {
+  VkDeviceSize offset = (uniformArena.head + uniformArena.alignment - 1) / uniformArena.alignment * uniformArena.alignment;
+  if (offset + size > uniformArena.regionEnd) {
+    throw std::runtime_error("uniform arena region is full!");
   }
+
+  memcpy(static_cast<char*>(uniformArena.memory.mapped) + offset, data, size);
+  uniformArena.head = offset + size;
+  return static_cast<uint32_t>(offset);
 }
 
-void updateUniformBuffer(uint32_t currentImage) {
+// Pushes the frame's camera and model transform and returns their dynamic
+// offset.
+uint32_t updateUniformBuffer() {
   static auto startTime = std::chrono::high_resolution_clock::now();
 
   auto currentTime = std::chrono::high_resolution_clock::now();
@@ -1332,7 +1862,7 @@ void updateUniformBuffer(uint32_t currentImage) {
     time*glm::radians(90.0f),
     glm::vec3(0.0f, 0.0f, 1.0f));
   ubo.view = glm::lookAt(
-    glm::vec3(2.0f, 2.0f, 2.0f),
+    cameraPosition,
     glm::vec3(0.0f, 0.0f, 0.0f),
     glm::vec3(0.0f, 0.0f, 1.0f));
   ubo.proj = glm::perspective(
@@ -1341,168 +1871,870 @@ void updateUniformBuffer(uint32_t currentImage) {
     0.1f, 10.0f);
   ubo.proj[1][1] *= -1; // convert from opengl convention to vulkan
 
-  void* data;
-  vkMapMemory(
-    device,
-    uniformBuffersMemory[currentImage],
-    0,
-    sizeof(UniformBufferObject),
-    0,
-    &data);
-
-  memcpy(data, &ubo, sizeof(ubo));
-
-  vkUnmapMemory(device, uniformBuffersMemory[currentImage]);
+  return pushUniforms(&ubo, sizeof(ubo));
 }
 
+// One set for the uniform arena and one for every texture; texture sets
+// are freed with their textures.
 void createDescriptorPool() {
   std::array<VkDescriptorPoolSize, 2> poolSizes{};
-  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  poolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  poolSizes[0].descriptorCount = 1;
   poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  poolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
-
+  poolSizes[1].descriptorCount = maxTextureDescriptorSets;
 
   VkDescriptorPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
   poolInfo.poolSizeCount = static_cast<size_t>(poolSizes.size());
   poolInfo.pPoolSizes = poolSizes.data();
-  poolInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
+  poolInfo.maxSets = 1 + maxTextureDescriptorSets;
 
   if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
     throw std::runtime_error("failed to create descriptor pool!");
   }
 }
 
-void createDescriptorSets() {
-  std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), descriptorSetLayout);
+// The arena's set, written once: frames pick their region with the dynamic
+// offset they bind it at.
+void createUniformDescriptorSet() {
   VkDescriptorSetAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   allocInfo.descriptorPool = descriptorPool;
-  allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
-  allocInfo.pSetLayouts = layouts.data();
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &descriptorSetLayout;
 
-  descriptorSets.resize(swapChainImages.size());
-  if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+  if (vkAllocateDescriptorSets(device, &allocInfo, &uniformDescriptorSet) != VK_SUCCESS) {
     throw std::runtime_error("failed to allocate descriptor sets!");
   }
 
-  for (size_t i = 0; i < swapChainImages.size(); i++) {
-    VkDescriptorBufferInfo bufferInfo;
-    bufferInfo.buffer = uniformBuffers[i];
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(UniformBufferObject);
-
-    VkDescriptorImageInfo imageInfo{};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = textureImageView;
-    imageInfo.sampler = textureSampler;
-
-    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = descriptorSets[i];
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &bufferInfo;
-    descriptorWrites[0].pImageInfo = nullptr;
-    descriptorWrites[0].pTexelBufferView = nullptr;
-
-    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = descriptorSets[i];
-    descriptorWrites[1].dstBinding = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[1].descriptorCount = 1;
-    descriptorWrites[1].pBufferInfo = nullptr;
-    descriptorWrites[1].pImageInfo = &imageInfo;
-    descriptorWrites[1].pTexelBufferView = nullptr;
-
-
-    vkUpdateDescriptorSets(
-      device,
-      static_cast<size_t>(descriptorWrites.size()),
-      descriptorWrites.data(),
-      0,
-      nullptr);
+  VkDescriptorBufferInfo bufferInfo;
+  bufferInfo.buffer = uniformArena.buffer;
+  bufferInfo.offset = 0;
+  bufferInfo.range = sizeof(UniformBufferObject);
+
+  VkWriteDescriptorSet descriptorWrite{};
+  descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptorWrite.dstSet = uniformDescriptorSet;
+  descriptorWrite.dstBinding = 0;
+  descriptorWrite.dstArrayElement = 0;
+  descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  descriptorWrite.descriptorCount = 1;
+  descriptorWrite.pBufferInfo = &bufferInfo;
+
+  vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+VkDescriptorSet createTextureDescriptorSet(VkImageView view) {
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &textureSetLayout;
+
+  VkDescriptorSet descriptorSet;
+  if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate texture descriptor set!");
+  }
+
+  VkDescriptorImageInfo imageInfo{};
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  imageInfo.imageView = view;
+  imageInfo.sampler = textureSampler;
+
+  VkWriteDescriptorSet descriptorWrite{};
+  descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptorWrite.dstSet = descriptorSet;
+  descriptorWrite.dstBinding = 0;
+  descriptorWrite.dstArrayElement = 0;
+  descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  descriptorWrite.descriptorCount = 1;
+  descriptorWrite.pImageInfo = &imageInfo;
+
+  vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+  return descriptorSet;
+}
+
+// First compressed sibling of texturePath that exists, otherwise the image
+// itself. Whether the device can sample it is only known later.
+std::string preferredTexturePath() {
+  for (const std::string& extension : compressedTextureExtensions) {
+    std::string path = std::filesystem::path(texturePath).replace_extension(extension).string();
+    if (std::filesystem::exists(path)) {
+      return path;
+    }
   }
+  return texturePath;
 }
 
-void createTextureImage() {
-  int texWidth, texHeight, texChannels;
+// Requested before anything else so reading and decoding overlap with
+// window, instance and device creation, and carry on while the first frames
+// are drawn with placeholders.
+void startAssetStreaming() {
+  textureAsset = requestTexture(preferredTexturePath());
+  if (std::filesystem::exists(modelPath)) {
+    modelAsset = requestModel();
+  }
+}
 
-  stbi_uc* pixels = stbi_load("textures/statue.png", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+// Nearer assets stream first. At the same distance geometry goes before
+// textures, since the placeholder quads are further off than a flat texture.
+float streamingPriority(const glm::vec3& eye, const glm::vec3& center, bool geometry) {
+  float priority = 1.0f / (1.0f + glm::distance(eye, center));
+  return geometry ? 2.0f * priority : priority;
+}
 
-  VkDeviceSize imageSize = texWidth * texHeight * 4;
+// Called every frame with the camera position; waiting requests are only
+// reordered when it has moved. Everything streamed so far belongs to the
+// model at the origin.
+void updateStreamingPriorities(const glm::vec3& eye) {
+  if (streamingEye == eye) {
+    return;
+  }
+  streamingEye = eye;
 
-  if (!pixels) {
-    throw std::runtime_error("failed to load texture image!");
+  glm::vec3 modelCenter(0.0f, 0.0f, 0.0f);
+  if (modelAsset != 0) {
+    assetStreamer.setPriority(modelAsset, streamingPriority(eye, modelCenter, true));
   }
+  if (textureAsset != 0) {
+    assetStreamer.setPriority(textureAsset, streamingPriority(eye, modelCenter, false));
+  }
+}
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
+void logStreamedAsset(const std::string& path) {
+  auto arrivalTime = std::chrono::high_resolution_clock::now();
+  std::cout << "streamed in " << path << " "
+    << std::chrono::duration<float, std::chrono::milliseconds::period>(arrivalTime - initStartTime).count()
+    << " ms after start" << std::endl;
+}
 
-  createBuffer(
-    imageSize,
-    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    stagingBuffer,
-    stagingBufferMemory);
+AssetId requestModel() {
+  AssetRequest request;
+  // read what loadModel will: the binary cache when there is one
+  std::string cachePath = meshCachePath(modelPath);
+  bool fromCache = std::filesystem::exists(cachePath);
+  request.path = fromCache ? cachePath : modelPath;
+  request.priority = streamingPriority(cameraPosition, glm::vec3(0.0f, 0.0f, 0.0f), true);
+  request.decode = [this, fromCache](MappedFile file) -> AssetCompletion {
+    auto loaded = std::make_shared<LoadedModel>(loadModel(std::move(file), fromCache));
+    return [this, loaded]() { replaceModel(*loaded); };
+  };
+  request.failed = [this](const std::exception& e) {
+    std::cout << "WARNING: failed to load " << modelPath << ": " << e.what() << std::endl;
+    modelAsset = 0;
+  };
+  return assetStreamer.request(std::move(request));
+}
+
+// Runs on the render thread, so it only copies loaded into staging.
+void replaceModel(const LoadedModel& loaded) {
+  modelAsset = 0;
+  std::cout << loaded.log;
+
+  Upload upload = beginUpload();
+  ModelBuffers buffers;
+  createIndexBuffer(upload, loaded, buffers);
+  createVertexBuffer(upload, loaded, buffers);
+
+  // the old model is drawn until the new one is on the GPU
+  submitUpload(std::move(upload), [this, buffers]() {
+    ModelBuffers old = modelBuffers;
+    retire([this, old]() { cleanupModelBuffers(old); });
+    modelBuffers = buffers;
+    modelBuffersGeneration++;
+
+    logStreamedAsset(modelPath);
+  });
+}
+
+AssetId requestTexture(const std::string& path) {
+  AssetRequest request;
+  request.path = path;
+  request.priority = streamingPriority(cameraPosition, glm::vec3(0.0f, 0.0f, 0.0f), false);
+  request.decode = [this, path](MappedFile file) -> AssetCompletion {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    auto loaded = std::make_shared<LoadedTexture>(loadTextureWithCache(path, &textureCache, std::move(file)));
+    auto endTime = std::chrono::high_resolution_clock::now();
+    loaded->decodeSeconds = std::chrono::duration<float, std::chrono::seconds::period>(endTime - startTime).count();
+    return [this, path, loaded]() { replaceTexture(path, std::move(*loaded)); };
+  };
+  request.failed = [this, path](const std::exception& e) { textureFailed(path, e); };
+  return assetStreamer.request(std::move(request));
+}
+
+// A compressed texture that fails to load or that the device cannot sample
+// is replaced by the decoded image.
+void textureFailed(const std::string& path, const std::exception& e) {
+  std::cout << "WARNING: not using " << path << ": " << e.what() << std::endl;
+  textureAsset = path != texturePath ? requestTexture(texturePath) : 0;
+
+  // a reload that found nothing leaves the texture as it was, and is not
+  // tried again every frame
+  if (textureAsset == 0 && modelTextureResidency != 0) {
+    textureResidency.reloadFailed(modelTextureResidency, modelTextureFirstLevel, frameNumber);
+  }
+}
+
+void replaceTexture(const std::string& path, LoadedTexture&& loaded) {
+  if (path != texturePath) {
+    try {
+      findSupportedFormat({loaded.texture.format}, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+    } catch (const std::exception& e) {
+      textureFailed(path, e);
+      return;
+    }
+  }
+  textureAsset = 0;
+
+  if (!loaded.warning.empty()) {
+    std::cout << "WARNING: " << loaded.warning << std::endl;
+  }
+  std::cout << "loaded " << path << (loaded.fromCache ? " from the texture cache" : "") << " (" << loaded.texture.levels.size() << " levels, "
+    << loaded.texture.uploadSize() / 1024 << " KiB) in " << loaded.decodeSeconds * 1000.0f << " ms" << std::endl;
+
+  Upload upload = beginUpload();
+  SampledTexture texture = createTextureImage(upload, loaded.texture, true);
+
+  // the old texture is sampled until the new one is on the GPU
+  submitUpload(std::move(upload), [this, texture, path]() {
+    retireModelTexture();
+    modelTexture = texture;
+
+    textureResidency.remove(modelTextureResidency);
+    modelTextureResidency = textureResidency.add(textureLevelSizes(texture));
+    modelTexture.residency = modelTextureResidency;
+    modelTexturePath = path;
+    modelTextureFirstLevel = 0;
+
+    logStreamedAsset(path);
+  });
+}
+
+// One grey texel and the built-in quads, drawn until the texture and model
+// have streamed in. Waits for the upload, so the first frame can use them.
+void createPlaceholders() {
+  Upload upload = beginUpload();
+
+  TextureData texture{};
+  texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+  texture.levels = { TextureLevel{ 1, 1, 0, 4, 0 } };
+  texture.pixels = { 128, 128, 128, 255 };
+  placeholderTexture = createTextureImage(upload, texture, false);
+  modelTexture = placeholderTexture;
+
+  LoadedModel quads;
+  quads.mesh = packIndices(MeshData{ vertices, indices }, indexWidthPolicy);
+  quads.vertices = prepareUploadVertices(quads.mesh.vertices.data(), quads.mesh.vertices.size(), vertexFormat);
+  createIndexBuffer(upload, quads, modelBuffers);
+  createVertexBuffer(upload, quads, modelBuffers);
+
+  submitUpload(std::move(upload), nullptr);
+  finishUploads();
+}
+
+void cleanupModelBuffers(const ModelBuffers& buffers) {
+  vkDestroyBuffer(device, buffers.positionBuffer, nullptr);
+  deviceAllocator->free(buffers.positionBufferMemory);
+
+  vkDestroyBuffer(device, buffers.attributeBuffer, nullptr);
+  deviceAllocator->free(buffers.attributeBufferMemory);
+
+  vkDestroyBuffer(device, buffers.indexBuffer, nullptr);
+  deviceAllocator->free(buffers.indexBufferMemory);
+}
+
+void cleanupTexture(const SampledTexture& texture) {
+  vkFreeDescriptorSets(device, descriptorPool, 1, &texture.descriptorSet);
+  vkDestroyImageView(device, texture.view, nullptr);
+  vkDestroyImage(device, texture.image, nullptr);
+  deviceAllocator->free(texture.memory);
+}
+
+// The placeholder outlives every model texture.
+void cleanupModelTexture() {
+  if (modelTexture.image != placeholderTexture.image) {
+    cleanupTexture(modelTexture);
+  }
+}
+
+// Like cleanupModelTexture, once frames and uploads are done sampling it.
+void retireModelTexture() {
+  if (modelTexture.image != placeholderTexture.image) {
+    SampledTexture texture = modelTexture;
+    retire([this, texture]() { cleanupTexture(texture); });
+  }
+}
+
+std::vector<uint64_t> textureLevelSizes(const SampledTexture& texture) {
+  std::vector<uint64_t> sizes(texture.mipLevels);
+  for (uint32_t level = 0; level < texture.mipLevels; level++) {
+    sizes[level] = textureLevelSize(
+      texture.format,
+      std::max(texture.width >> level, 1u),
+      std::max(texture.height >> level, 1u));
+  }
+  return sizes;
+}
+
+// Called every frame before recording: carries out what the residency
+// manager decides from the frames recorded so far.
+void updateTextureResidency() {
+  frameNumber++;
+
+  for (const ResidencyChange& change : textureResidency.trim(frameNumber)) {
+    applyResidencyChange(change);
+  }
+  for (const ResidencyChange& change : textureResidency.reloads(frameNumber)) {
+    applyResidencyChange(change);
+  }
+}
+
+void applyResidencyChange(const ResidencyChange& change) {
+  if (change.texture != modelTextureResidency) {
+    return;
+  }
+
+  if (change.firstLevel >= change.levelCount) {
+    evictModelTexture(change.levelCount);
+  } else if (change.firstLevel > modelTextureFirstLevel) {
+    shrinkModelTexture(change.firstLevel);
+  } else {
+    std::cout << "reloading " << modelTexturePath << " now that it fits the texture budget" << std::endl;
+    textureAsset = requestTexture(modelTexturePath);
+  }
+}
+
+void evictModelTexture(uint32_t levelCount) {
+  std::cout << "evicting " << modelTexturePath << " to stay within the texture budget" << std::endl;
+
+  retireModelTexture();
+  modelTexture = placeholderTexture;
 
-  void* data;
-  vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-  memcpy(data, pixels, static_cast<size_t>(imageSize));
-  vkUnmapMemory(device, stagingBufferMemory);
+  modelTextureFirstLevel = levelCount;
+  textureResidency.settled(modelTextureResidency, modelTextureFirstLevel);
+}
+
+// Replaces the model texture with a copy of its levels from firstLevel on,
+// made on the GPU.
+void shrinkModelTexture(uint32_t firstLevel) {
+  uint32_t dropLevels = firstLevel - modelTextureFirstLevel;
+  std::cout << "dropping the top " << dropLevels << " levels of " << modelTexturePath
+    << " to stay within the texture budget" << std::endl;
+
+  Upload upload = beginUpload();
+  SampledTexture shrunk = copyTextureFromLevel(upload.graphicsCommands, modelTexture, dropLevels);
+
+  ResidentTextureId texture = modelTextureResidency;
+  submitUpload(std::move(upload), [this, shrunk, texture, firstLevel]() {
+    // a new texture streamed in meanwhile
+    if (texture != modelTextureResidency) {
+      cleanupTexture(shrunk);
+      return;
+    }
+
+    retireModelTexture();
+    modelTexture = shrunk;
+    modelTextureFirstLevel = firstLevel;
+
+    textureResidency.settled(texture, firstLevel);
+  });
+}
 
-  stbi_image_free(pixels);
+// Records copying the levels of texture from firstLevel on into a new
+// texture, smaller unless firstLevel is 0. texture is sampled again once the
+// copy is done.
+SampledTexture copyTextureFromLevel(VkCommandBuffer commandBuffer, const SampledTexture& texture, uint32_t firstLevel) {
+  SampledTexture copy{};
+  copy.format = texture.format;
+  copy.width = std::max(texture.width >> firstLevel, 1u);
+  copy.height = std::max(texture.height >> firstLevel, 1u);
+  copy.mipLevels = texture.mipLevels - firstLevel;
+  copy.residency = texture.residency;
 
   createImage(
-    texWidth,
-    texHeight,
-    VK_FORMAT_R8G8B8A8_SRGB,
+    copy.width,
+    copy.height,
+    copy.mipLevels,
+    copy.format,
     VK_IMAGE_TILING_OPTIMAL,
-    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    textureImage,
-    textureImageMemory
-    );
+    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    MemoryUsage::GpuOnly,
+    copy.image,
+    copy.memory,
+    true);
+
+  std::array<VkImageMemoryBarrier, 2> barriers{};
+  for (VkImageMemoryBarrier& barrier : barriers) {
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+  }
+
+  barriers[0].image = texture.image;
+  barriers[0].subresourceRange.baseMipLevel = firstLevel;
+  barriers[0].subresourceRange.levelCount = copy.mipLevels;
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  barriers[1].image = copy.image;
+  barriers[1].subresourceRange.baseMipLevel = 0;
+  barriers[1].subresourceRange.levelCount = copy.mipLevels;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[1].srcAccessMask = 0;
+  barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 
-  transitionImageLayout(
-    textureImage,
-    VK_FORMAT_R8G8B8A8_SRGB,
-    VK_IMAGE_LAYOUT_UNDEFINED,
-    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-    );
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    0,
+    0, nullptr,
+    0, nullptr,
+    static_cast<uint32_t>(barriers.size()), barriers.data());
+
+  std::vector<VkImageCopy> regions(copy.mipLevels);
+  for (uint32_t level = 0; level < copy.mipLevels; level++) {
+    VkImageCopy& region = regions[level];
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.mipLevel = firstLevel + level;
+    region.srcSubresource.baseArrayLayer = 0;
+    region.srcSubresource.layerCount = 1;
+    region.dstSubresource = region.srcSubresource;
+    region.dstSubresource.mipLevel = level;
+    region.srcOffset = { 0, 0, 0 };
+    region.dstOffset = { 0, 0, 0 };
+    region.extent = { std::max(copy.width >> level, 1u), std::max(copy.height >> level, 1u), 1 };
+  }
+
+  vkCmdCopyImage(
+    commandBuffer,
+    texture.image,
+    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    copy.image,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    static_cast<uint32_t>(regions.size()),
+    regions.data());
 
-  copyBufferToImage(
-    stagingBuffer,
-    textureImage,
-    static_cast<uint32_t>(texWidth),
-    static_cast<uint32_t>(texHeight)
-    );
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+    0,
+    0, nullptr,
+    0, nullptr,
+    static_cast<uint32_t>(barriers.size()), barriers.data());
+
+  copy.view = createImageView(copy.image, copy.format, VK_IMAGE_ASPECT_COLOR_BIT, copy.mipLevels);
+  copy.descriptorSet = createTextureDescriptorSet(copy.view);
+  return copy;
+}
+
+// Empties sparsely used device memory blocks a few resources at a time:
+// every defragmentationInterval frames the allocator picks the blocks, then
+// each frame copies up to defragmentationBytesPerFrame of the model's
+// buffers and texture out of them, a resource larger than that in a frame of
+// its own. The pass ends once nothing that can be moved is left in them; the
+// placeholder, depth image and uniform arena stay where they are.
+void updateDefragmentation() {
+  if (!defragmentation) {
+    if (frameNumber % defragmentationInterval != 0) {
+      return;
+    }
+
+    DeviceAllocatorStats before = deviceAllocator->stats();
+    uint32_t blockCount = deviceAllocator->beginDefragmentation(defragmentationMaxBlockUsage);
+    if (blockCount == 0) {
+      return;
+    }
+
+    std::cout << "defragmenting device memory: emptying " << blockCount << " of " << before.blockCount
+      << " blocks, " << before.fragmentation * 100.0f << "% fragmented" << std::endl;
+
+    defragmentation = DefragmentationPass{};
+    defragmentation->startFrame = frameNumber;
+    defragmentation->before = before;
+  }
+
+  VkDeviceSize bytesLeft = defragmentationBytesPerFrame;
+  bool started = false;
+  auto withinBudget = [&](VkDeviceSize size) {
+    if (started && size > bytesLeft) {
+      return false;
+    }
+    bytesLeft -= std::min(size, bytesLeft);
+    started = true;
+    return true;
+  };
+
+  VkDeviceSize bufferBytes = evacuatingModelBufferBytes();
+  bool buffersLeft = !defragmentation->movingModelBuffers && bufferBytes > 0;
+  if (buffersLeft && withinBudget(bufferBytes)) {
+    moveModelBuffers();
+    buffersLeft = false;
+  }
 
+  bool textureLeft = !defragmentation->movingModelTexture
+    && modelTexture.image != placeholderTexture.image
+    && deviceAllocator->evacuating(modelTexture.memory);
+  if (textureLeft && withinBudget(modelTexture.memory.size)) {
+    moveModelTexture();
+    textureLeft = false;
+  }
+
+  // moved-out resources are retired, and their blocks only empty once
+  // they are destroyed
+  if (!buffersLeft && !textureLeft && !defragmentation->movingModelBuffers && !defragmentation->movingModelTexture
+    && retiredResources.empty())
+  {
+    finishDefragmentation();
+  }
+}
+
+VkDeviceSize evacuatingModelBufferBytes() {
+  VkDeviceSize bytes = 0;
+  if (deviceAllocator->evacuating(modelBuffers.positionBufferMemory)) {
+    bytes += modelBuffers.positionBufferSize;
+  }
+  if (deviceAllocator->evacuating(modelBuffers.attributeBufferMemory)) {
+    bytes += modelBuffers.attributeBufferSize;
+  }
+  if (deviceAllocator->evacuating(modelBuffers.indexBufferMemory)) {
+    bytes += modelBuffers.indexBufferSize;
+  }
+  return bytes;
+}
+
+// Copies the model's buffers that are in blocks being emptied into new
+// ones, which are drawn from once the copies are done. Freeing the old
+// buffers frees their blocks once nothing else is left in them.
+void moveModelBuffers() {
+  Upload upload = beginUpload();
+  ModelBuffers source = modelBuffers;
+  ModelBuffers moved = modelBuffers;
+  uint32_t movedCount = 0;
+  VkDeviceSize movedBytes = 0;
+
+  auto moveBuffer = [&](VkBuffer& buffer, DeviceAllocation& memory, VkDeviceSize size, VkBufferUsageFlags usage) {
+    if (!deviceAllocator->evacuating(memory)) {
+      return;
+    }
+
+    VkBuffer sourceBuffer = buffer;
+    createBuffer(
+      size,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+      MemoryUsage::GpuOnly,
+      buffer,
+      memory,
+      true);
+    copyBuffer(upload.graphicsCommands, sourceBuffer, 0, buffer, size);
+
+    movedCount++;
+    movedBytes += size;
+  };
+  moveBuffer(moved.positionBuffer, moved.positionBufferMemory, moved.positionBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  moveBuffer(moved.attributeBuffer, moved.attributeBufferMemory, moved.attributeBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  moveBuffer(moved.indexBuffer, moved.indexBufferMemory, moved.indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(
+    upload.graphicsCommands,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+    0,
+    1, &barrier,
+    0, nullptr,
+    0, nullptr);
+
+  defragmentation->movingModelBuffers = true;
+  uint64_t generation = modelBuffersGeneration;
+  submitUpload(std::move(upload), [this, source, moved, generation, movedCount, movedBytes]() {
+    defragmentation->movingModelBuffers = false;
+
+    // a new model streamed in meanwhile
+    if (generation != modelBuffersGeneration) {
+      cleanupModelBuffersNotIn(moved, source);
+      return;
+    }
+
+    retire([this, source, moved]() { cleanupModelBuffersNotIn(source, moved); });
+    modelBuffers = moved;
+
+    defragmentation->movedCount += movedCount;
+    defragmentation->movedBytes += movedBytes;
+  });
+}
+
+// Destroys the buffers of buffers that other does not share.
+void cleanupModelBuffersNotIn(const ModelBuffers& buffers, const ModelBuffers& other) {
+  if (buffers.positionBuffer != other.positionBuffer) {
+    vkDestroyBuffer(device, buffers.positionBuffer, nullptr);
+    deviceAllocator->free(buffers.positionBufferMemory);
+  }
+  if (buffers.attributeBuffer != other.attributeBuffer) {
+    vkDestroyBuffer(device, buffers.attributeBuffer, nullptr);
+    deviceAllocator->free(buffers.attributeBufferMemory);
+  }
+  if (buffers.indexBuffer != other.indexBuffer) {
+    vkDestroyBuffer(device, buffers.indexBuffer, nullptr);
+    deviceAllocator->free(buffers.indexBufferMemory);
+  }
+}
+
+// Copies the model texture out of a block being emptied and draws with the
+// copy once it is done.
+void moveModelTexture() {
+  Upload upload = beginUpload();
+  SampledTexture moved = copyTextureFromLevel(upload.graphicsCommands, modelTexture, 0);
+
+  defragmentation->movingModelTexture = true;
+  ResidentTextureId texture = modelTextureResidency;
+  uint32_t firstLevel = modelTextureFirstLevel;
+  VkDeviceSize movedBytes = modelTexture.memory.size;
+  submitUpload(std::move(upload), [this, moved, texture, firstLevel, movedBytes]() {
+    defragmentation->movingModelTexture = false;
+
+    // a new texture streamed in, or the texture budget changed its levels
+    if (texture != modelTextureResidency || firstLevel != modelTextureFirstLevel) {
+      cleanupTexture(moved);
+      return;
+    }
+
+    retireModelTexture();
+    modelTexture = moved;
+
+    defragmentation->movedCount++;
+    defragmentation->movedBytes += movedBytes;
+  });
+}
+
+void finishDefragmentation() {
+  deviceAllocator->endDefragmentation();
+
+  const DeviceAllocatorStats& before = defragmentation->before;
+  DeviceAllocatorStats after = deviceAllocator->stats();
+  std::cout << "defragmented device memory in " << frameNumber - defragmentation->startFrame << " frames: moved "
+    << defragmentation->movedCount << " resources, " << defragmentation->movedBytes / 1024 << " KiB; "
+    << before.blockCount << " -> " << after.blockCount << " blocks, "
+    << before.blockBytes / (1024 * 1024) << " -> " << after.blockBytes / (1024 * 1024) << " MiB, "
+    << before.freeRangeCount << " -> " << after.freeRangeCount << " free ranges, "
+    << before.fragmentation * 100.0f << "% -> " << after.fragmentation * 100.0f << "% fragmented" << std::endl;
+
+  defragmentation.reset();
+}
+
+// Records the upload of every level of texture, and the generation of the
+// rest of its mip chain when it comes with a single level. movable when
+// defragmentation may move it, see moveModelTexture.
+SampledTexture createTextureImage(Upload& upload, const TextureData& texture, bool movable) {
+  const TextureLevel& topLevel = texture.levels[0];
+
+  // without pre-baked levels the whole chain is blitted from the top level;
+  // block compressed formats cannot be blitted to, so they only get the
+  // levels they come with
+  bool generateMips = texture.levels.size() == 1 && !isBlockCompressed(texture.format);
+
+  SampledTexture sampled{};
+  sampled.format = texture.format;
+  sampled.width = topLevel.width;
+  sampled.height = topLevel.height;
+  sampled.mipLevels = generateMips
+    ? mipLevelCount(topLevel.width, topLevel.height)
+    : static_cast<uint32_t>(texture.levels.size());
+
+  StagingRegion staging = stageUpload(upload, texture.uploadSize(), [&](void* data) {
+    copyTextureLevels(texture, data);
+  });
+
+  createImage(
+    topLevel.width,
+    topLevel.height,
+    sampled.mipLevels,
+    sampled.format,
+    VK_IMAGE_TILING_OPTIMAL,
+    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    MemoryUsage::GpuOnly,
+    sampled.image,
+    sampled.memory,
+    movable);
+
+  // the copies run on the transfer queue, blits and the final transition
+  // need the graphics queue
   transitionImageLayout(
-    textureImage,
-    VK_FORMAT_R8G8B8A8_SRGB,
+    upload.transferCommands,
+    sampled.image,
+    sampled.format,
+    VK_IMAGE_LAYOUT_UNDEFINED,
     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    sampled.mipLevels
     );
 
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+  copyBufferToImage(upload.transferCommands, staging.buffer, staging.offset, sampled.image, texture.levels);
+
+  transferImageOwnership(upload, sampled.image, sampled.mipLevels);
+
+  if (generateMips) {
+    generateMipmaps(
+      upload.graphicsCommands,
+      sampled.image,
+      sampled.format,
+      topLevel.width,
+      topLevel.height,
+      sampled.mipLevels);
+  } else {
+    transitionImageLayout(
+      upload.graphicsCommands,
+      sampled.image,
+      sampled.format,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      sampled.mipLevels
+      );
+  }
+
+  sampled.view = createImageView(sampled.image, sampled.format, VK_IMAGE_ASPECT_COLOR_BIT, sampled.mipLevels);
+  sampled.descriptorSet = createTextureDescriptorSet(sampled.view);
+  return sampled;
+}
+
+// Fills levels 1 and up by blitting each level from the one above it, and
+// leaves the whole chain in SHADER_READ_ONLY_OPTIMAL. Expects every level in
+// TRANSFER_DST_OPTIMAL with level 0 already written.
+void generateMipmaps(
+  VkCommandBuffer commandBuffer,
+  VkImage image,
+  VkFormat format,
+  uint32_t width,
+  uint32_t height,
+  uint32_t mipLevels)
+{
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+
+  const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT
+    | VK_FORMAT_FEATURE_BLIT_DST_BIT
+    | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  if ((formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures) {
+    throw std::runtime_error("texture image format does not support linear blitting!");
+  }
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.subresourceRange.levelCount = 1;
+
+  int32_t mipWidth = static_cast<int32_t>(width);
+  int32_t mipHeight = static_cast<int32_t>(height);
+
+  for (uint32_t i = 1; i < mipLevels; i++) {
+    // the previous level has been written, read from it next
+    barrier.subresourceRange.baseMipLevel = i - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      0, nullptr,
+      0, nullptr,
+      1, &barrier);
+
+    int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+    int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+    VkImageBlit blit{};
+    blit.srcOffsets[0] = { 0, 0, 0 };
+    blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = i - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.dstOffsets[0] = { 0, 0, 0 };
+    blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel = i;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+
+    vkCmdBlitImage(
+      commandBuffer,
+      image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      1, &blit,
+      VK_FILTER_LINEAR);
+
+    mipWidth = nextWidth;
+    mipHeight = nextHeight;
+  }
+
+  // every level but the last was a blit source; move the whole chain to
+  // shader reads with a single barrier call
+  std::array<VkImageMemoryBarrier, 2> finalBarriers{ barrier, barrier };
+  uint32_t finalBarrierCount = 0;
+
+  if (mipLevels > 1) {
+    VkImageMemoryBarrier& sources = finalBarriers[finalBarrierCount++];
+    sources.subresourceRange.baseMipLevel = 0;
+    sources.subresourceRange.levelCount = mipLevels - 1;
+    sources.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    sources.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    sources.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    sources.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  }
+
+  VkImageMemoryBarrier& lastLevel = finalBarriers[finalBarrierCount++];
+  lastLevel.subresourceRange.baseMipLevel = mipLevels - 1;
+  lastLevel.subresourceRange.levelCount = 1;
+  lastLevel.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  lastLevel.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  lastLevel.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  lastLevel.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+    0,
+    0, nullptr,
+    0, nullptr,
+    finalBarrierCount, finalBarriers.data());
 }
 
 void createImage(
   uint32_t width,
   uint32_t height,
+  uint32_t mipLevels,
   VkFormat format,
   VkImageTiling tiling,
   VkImageUsageFlags usage,
-  VkMemoryPropertyFlags properties,
+  MemoryUsage memoryUsage,
   VkImage& image,
-  VkDeviceMemory& imageMemory) 
+  DeviceAllocation& imageMemory,
+  bool movable = false)
 {
   VkImageCreateInfo imageInfo{};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1510,7 +2742,7 @@ void createImage(
   imageInfo.extent.width = static_cast<size_t>(width);
   imageInfo.extent.height = static_cast<size_t>(height);
   imageInfo.extent.depth = 1;
-  imageInfo.mipLevels = 1;
+  imageInfo.mipLevels = mipLevels;
   imageInfo.arrayLayers = 1;
   imageInfo.format = format;
   imageInfo.tiling = tiling;
@@ -1527,22 +2759,15 @@ void createImage(
   VkMemoryRequirements memRequriements{};
   vkGetImageMemoryRequirements(device, image, &memRequriements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequriements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequriements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
-  }
+  imageMemory = deviceAllocator->allocate(memRequriements, memoryUsage, tiling == VK_IMAGE_TILING_LINEAR, movable);
 
-  vkBindImageMemory(device, image, imageMemory, 0);
+  vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
 }
 
-VkCommandBuffer beginSingleTimeCommands() {
+VkCommandBuffer beginSingleTimeCommands(VkCommandPool pool) {
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.commandPool = commandPool;
+  allocInfo.commandPool = pool;
   allocInfo.commandBufferCount = 1;
 
   VkCommandBuffer commandBuffer;
@@ -1557,28 +2782,404 @@ VkCommandBuffer beginSingleTimeCommands() {
   return commandBuffer;
 }
 
-void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-  vkEndCommandBuffer(commandBuffer);
+Upload beginUpload() {
+  Upload upload;
+  upload.transferCommands = beginSingleTimeCommands(transferCommandPool);
+  upload.graphicsCommands = beginSingleTimeCommands(commandPool);
+  return upload;
+}
+
+void createStagingRing() {
+  createBuffer(
+    stagingRingSize,
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    MemoryUsage::Upload,
+    stagingRingBuffer,
+    stagingRingMemory);
+
+  // BC blocks are at most 16 bytes, and copies go fastest from offsets
+  // aligned the way the device prefers
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  stagingAlignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+}
+
+void logTextureResidency() {
+  TextureResidencyStats stats = textureResidency.stats();
+  std::cout << "texture residency: " << stats.evictions << " evictions, " << stats.droppedLevels << " levels dropped, "
+    << stats.reloads << " reloads, peak " << stats.peakResidentBytes / (1024 * 1024) << " of "
+    << stats.budgetBytes / (1024 * 1024) << " MiB budget" << std::endl;
+}
+
+void logDeviceMemory() {
+  DeviceAllocatorStats stats = deviceAllocator->stats();
+  std::cout << "device memory: " << stats.allocationCount << " resources in " << stats.blockCount << " blocks of "
+    << stats.blockBytes / (1024 * 1024) << " MiB, " << stats.usedBytes / (1024 * 1024) << " MiB used, "
+    << stats.freeRangeCount << " free ranges, " << stats.fragmentation * 100.0f << "% fragmented; "
+    << stats.dedicatedCount << " resources with memory of their own, "
+    << stats.dedicatedBytes / (1024 * 1024) << " MiB" << std::endl;
+
+  for (const MemoryPlacement& placement : stats.placements) {
+    std::cout << "  " << memoryUsageName(placement.usage) << ": " << placement.resourceCount << " resources, "
+      << placement.bytes / 1024 << " KiB in memory type " << placement.memoryType
+      << " (" << memoryPropertyNames(placement.flags) << ") on heap " << placement.heap << std::endl;
+  }
+  for (size_t i = 0; i < stats.heaps.size(); i++) {
+    const MemoryHeapStats& heap = stats.heaps[i];
+    std::cout << "  heap " << i << (heap.deviceLocal ? " (device local)" : "") << ": "
+      << heap.usage / (1024 * 1024) << " of " << heap.budget / (1024 * 1024) << " MiB budget used"
+      << (stats.memoryBudget ? "" : " (estimated)") << ", "
+      << heap.allocatorBytes / (1024 * 1024) << " MiB by the allocator" << std::endl;
+  }
+  if (stats.fallbackCount > 0 || stats.overBudgetCount > 0) {
+    std::cout << "WARNING: " << stats.fallbackCount << " allocations moved to other memory types and "
+      << stats.overBudgetCount << " went over budget" << std::endl;
+  }
+}
+
+std::string memoryPropertyNames(VkMemoryPropertyFlags flags) {
+  const std::pair<VkMemoryPropertyFlags, const char*> names[] = {
+    { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "device local" },
+    { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "host visible" },
+    { VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "host coherent" },
+    { VK_MEMORY_PROPERTY_HOST_CACHED_BIT, "host cached" },
+  };
+
+  std::string result;
+  for (const auto& name : names) {
+    if (flags & name.first) {
+      result += result.empty() ? "" : ", ";
+      result += name.second;
+    }
+  }
+  return result.empty() ? "no flags" : result;
+}
+
+void cleanupStagingRing() {
+  RingAllocatorStats stats = stagingRing.stats();
+  std::cout << "staging ring: " << stats.allocationCount << " uploads, peak "
+    << stats.peakBytesInUse / 1024 << " of " << stagingRingSize / 1024 << " KiB, "
+    << stagingRingWaits << " waits for space, "
+    << dedicatedStagingBuffers << " too large for it" << std::endl;
+
+  vkDestroyBuffer(device, stagingRingBuffer, nullptr);
+  deviceAllocator->free(stagingRingMemory);
+}
+
+// Finds size bytes of staging memory that stay put as long as upload's
+// copies may read them, and lets write fill them. They come from the ring,
+// after waiting for older uploads to make room if need be, and only
+// uploads larger than the ring get a buffer of their own.
+StagingRegion stageUpload(Upload& upload, VkDeviceSize size, const std::function<void(void*)>& write) {
+  std::optional<RingAllocation> allocation = stagingRing.allocate(size, stagingAlignment);
+  while (!allocation && size <= stagingRing.capacity() && !pendingUploads.empty()) {
+    stagingRingWaits++;
+    const Upload& oldest = pendingUploads.front();
+    VkFence copiesDone = oldest.transferFence != VK_NULL_HANDLE ? oldest.transferFence : oldest.fence;
+    vkWaitForFences(device, 1, &copiesDone, VK_TRUE, UINT64_MAX);
+    reclaimUploads();
+    allocation = stagingRing.allocate(size, stagingAlignment);
+  }
+
+  if (allocation) {
+    upload.stagingRingAllocations.push_back(allocation->id);
+    write(static_cast<char*>(stagingRingMemory.mapped) + allocation->offset);
+    return { stagingRingBuffer, allocation->offset };
+  }
+
+  dedicatedStagingBuffers++;
+
+  VkBuffer stagingBuffer;
+  DeviceAllocation stagingBufferMemory;
+  createBuffer(
+    size,
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    MemoryUsage::Upload,
+    stagingBuffer,
+    stagingBufferMemory);
+  upload.stagingBuffers.push_back(stagingBuffer);
+  upload.stagingBuffersMemory.push_back(stagingBufferMemory);
+
+  write(stagingBufferMemory.mapped);
+
+  return { stagingBuffer, 0 };
+}
+
+// Hands upload's staging memory back once its copies have run.
+void releaseStaging(Upload& upload) {
+  for (uint64_t allocation : upload.stagingRingAllocations) {
+    stagingRing.release(allocation);
+  }
+  for (size_t i = 0; i < upload.stagingBuffers.size(); i++) {
+    vkDestroyBuffer(device, upload.stagingBuffers[i], nullptr);
+    deviceAllocator->free(upload.stagingBuffersMemory[i]);
+  }
+  upload.stagingRingAllocations.clear();
+  upload.stagingBuffers.clear();
+  upload.stagingBuffersMemory.clear();
+}
+
+// Hands buffer, just written by the transfer commands of upload, over to the
+// graphics queue for vertex input. Between queue families that takes a
+// release on the transfer side and a matching acquire on the graphics side;
+// on a single queue it is an ordinary barrier.
+void transferBufferOwnership(const Upload& upload, VkBuffer buffer) {
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = buffer;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+
+  VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+  if (transferQueueFamily != graphicsQueueFamily) {
+    barrier.srcQueueFamilyIndex = transferQueueFamily;
+    barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+
+    VkBufferMemoryBarrier release = barrier;
+    release.dstAccessMask = 0;
+    vkCmdPipelineBarrier(
+      upload.transferCommands,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      0,
+      0, nullptr,
+      1, &release,
+      0, nullptr);
+
+    // the semaphore between the submits makes the writes available
+    barrier.srcAccessMask = 0;
+    sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  }
+
+  vkCmdPipelineBarrier(
+    upload.graphicsCommands,
+    sourceStage, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+    0,
+    0, nullptr,
+    1, &barrier,
+    0, nullptr);
+}
+
+// Like transferBufferOwnership for an image whose levels the transfer
+// commands wrote. It stays in TRANSFER_DST_OPTIMAL, for the graphics queue
+// to generate mips or transition it for sampling.
+void transferImageOwnership(const Upload& upload, VkImage image, uint32_t mipLevels) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mipLevels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+
+  VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+  if (transferQueueFamily != graphicsQueueFamily) {
+    barrier.srcQueueFamilyIndex = transferQueueFamily;
+    barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+
+    VkImageMemoryBarrier release = barrier;
+    release.dstAccessMask = 0;
+    vkCmdPipelineBarrier(
+      upload.transferCommands,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      0,
+      0, nullptr,
+      0, nullptr,
+      1, &release);
+
+    barrier.srcAccessMask = 0;
+    sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  }
+
+  vkCmdPipelineBarrier(
+    upload.graphicsCommands,
+    sourceStage, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    0,
+    0, nullptr,
+    0, nullptr,
+    1, &barrier);
+}
+
+VkFence createUploadFence() {
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+  VkFence fence;
+  if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create upload fence!");
+  }
+  return fence;
+}
+
+// Submits both halves of upload at once. With a separate transfer queue the
+// graphics half waits for the copies on a semaphore, and the transfer half
+// gets a fence of its own so the staging is released as soon as the copies
+// are done.
+void submitUpload(Upload&& upload, std::function<void()> onComplete) {
+  if (vkEndCommandBuffer(upload.transferCommands) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record upload transfer commands!");
+  }
+  if (vkEndCommandBuffer(upload.graphicsCommands) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record upload graphics commands!");
+  }
+  upload.onComplete = std::move(onComplete);
+  upload.serial = ++uploadsSubmitted;
+  upload.fence = createUploadFence();
 
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue);
+  if (transferQueueFamily == graphicsQueueFamily) {
+    VkCommandBuffer uploadCommandBuffers[] = { upload.transferCommands, upload.graphicsCommands };
+    submitInfo.commandBufferCount = 2;
+    submitInfo.pCommandBuffers = uploadCommandBuffers;
 
-  vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, upload.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload!");
+    }
+  } else {
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &upload.transferDone) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload semaphore!");
+    }
+    upload.transferFence = createUploadFence();
+
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &upload.transferCommands;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &upload.transferDone;
+
+    if (vkQueueSubmit(transferQueue, 1, &submitInfo, upload.transferFence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload!");
+    }
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkSubmitInfo acquireInfo{};
+    acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    acquireInfo.waitSemaphoreCount = 1;
+    acquireInfo.pWaitSemaphores = &upload.transferDone;
+    acquireInfo.pWaitDstStageMask = &waitStage;
+    acquireInfo.commandBufferCount = 1;
+    acquireInfo.pCommandBuffers = &upload.graphicsCommands;
+
+    if (vkQueueSubmit(graphicsQueue, 1, &acquireInfo, upload.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload!");
+    }
+  }
+
+  pendingUploads.push_back(std::move(upload));
+}
+
+// Moves uploads along without waiting: releases the staging of those whose
+// copies are done, and frees and completes those the graphics queue is done
+// with. Called every frame.
+void reclaimUploads() {
+  std::vector<std::function<void()>> completions;
+
+  for (auto upload = pendingUploads.begin(); upload != pendingUploads.end();) {
+    if (upload->transferFence != VK_NULL_HANDLE && vkGetFenceStatus(device, upload->transferFence) == VK_SUCCESS) {
+      releaseStaging(*upload);
+      vkDestroyFence(device, upload->transferFence, nullptr);
+      upload->transferFence = VK_NULL_HANDLE;
+    }
+
+    if (vkGetFenceStatus(device, upload->fence) != VK_SUCCESS) {
+      ++upload;
+      continue;
+    }
+    releaseStaging(*upload);
+
+    vkFreeCommandBuffers(device, transferCommandPool, 1, &upload->transferCommands);
+    vkFreeCommandBuffers(device, commandPool, 1, &upload->graphicsCommands);
+    if (upload->transferDone != VK_NULL_HANDLE) {
+      vkDestroySemaphore(device, upload->transferDone, nullptr);
+    }
+    if (upload->transferFence != VK_NULL_HANDLE) {
+      vkDestroyFence(device, upload->transferFence, nullptr);
+    }
+    vkDestroyFence(device, upload->fence, nullptr);
+
+    if (upload->onComplete) {
+      completions.push_back(std::move(upload->onComplete));
+    }
+    upload = pendingUploads.erase(upload);
+  }
+
+  for (const auto& completion : completions) {
+    completion();
+  }
+}
+
+// Destroys what destroy frees once every frame and upload submitted so far
+// is done with it.
+void retire(std::function<void()> destroy) {
+  retiredResources.push_back({ MAX_FRAMES_IN_FLIGHT, uploadsSubmitted, std::move(destroy) });
+}
+
+// Called after each wait for a frame fence: once a resource has seen as
+// many as there are frames in flight, every frame submitted before it was
+// retired is done.
+void releaseRetired() {
+  uint64_t oldestUpload = UINT64_MAX;
+  for (const Upload& upload : pendingUploads) {
+    oldestUpload = std::min(oldestUpload, upload.serial);
+  }
+
+  for (auto resource = retiredResources.begin(); resource != retiredResources.end();) {
+    if (resource->framesLeft > 0) {
+      resource->framesLeft--;
+    }
+    if (resource->framesLeft > 0 || oldestUpload <= resource->lastUpload) {
+      ++resource;
+      continue;
+    }
+    resource->destroy();
+    resource = retiredResources.erase(resource);
+  }
+}
+
+// The device must be idle.
+void releaseAllRetired() {
+  for (const RetiredResource& resource : retiredResources) {
+    resource.destroy();
+  }
+  retiredResources.clear();
+}
+
+// Blocks until every upload has completed.
+void finishUploads() {
+  while (!pendingUploads.empty()) {
+    std::vector<VkFence> fences;
+    for (const Upload& upload : pendingUploads) {
+      fences.push_back(upload.fence);
+    }
+    vkWaitForFences(device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX);
+    reclaimUploads();
+  }
 }
 
 void transitionImageLayout(
+  VkCommandBuffer commandBuffer,
   VkImage image,
   VkFormat format,
   VkImageLayout oldLayout,
-  VkImageLayout newLayout)
+  VkImageLayout newLayout,
+  uint32_t mipLevels)
 {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
   VkImageMemoryBarrier barrier{};
   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
   barrier.oldLayout = oldLayout;
@@ -1587,7 +3188,7 @@ void transitionImageLayout(
   barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   barrier.image = image;
   barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.levelCount = mipLevels;
   barrier.subresourceRange.baseArrayLayer = 0;
   barrier.subresourceRange.layerCount = 1;
 
@@ -1645,42 +3246,49 @@ void transitionImageLayout(
     0, nullptr,
     0, nullptr,
     1, &barrier);
-
-  endSingleTimeCommands(commandBuffer);
 }
 
-void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+// Copies each level from its offset past bufferOffset into the matching mip
+// level.
+void copyBufferToImage(
+  VkCommandBuffer commandBuffer,
+  VkBuffer buffer,
+  VkDeviceSize bufferOffset,
+  VkImage image,
+  const std::vector<TextureLevel>& levels)
+{
+  std::vector<VkBufferImageCopy> regions(levels.size());
 
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferImageHeight = 0;
-  region.bufferRowLength = 0;
+  for (size_t i = 0; i < levels.size(); i++) {
+    VkBufferImageCopy& region = regions[i];
+    region.bufferOffset = bufferOffset + levels[i].offset;
+    region.bufferImageHeight = 0;
+    region.bufferRowLength = 0;
 
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = 1;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = static_cast<uint32_t>(i);
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
 
-  region.imageOffset = { 0, 0, 0 };
-  region.imageExtent = { width, height, 1 };
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { levels[i].width, levels[i].height, 1 };
+  }
 
   vkCmdCopyBufferToImage(
     commandBuffer,
     buffer,
     image,
     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-    1,
-    &region);
-
-  endSingleTimeCommands(commandBuffer);
-}
-
-void createTextureImageView() {
-  textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+    static_cast<uint32_t>(regions.size()),
+    regions.data());
 }
 
-VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
+VkImageView createImageView(
+  VkImage image,
+  VkFormat format,
+  VkImageAspectFlags aspectFlags,
+  uint32_t mipLevels)
+{
   VkImageViewCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   createInfo.image = image;
@@ -1692,7 +3300,7 @@ VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags a
   createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
   createInfo.subresourceRange.aspectMask = aspectFlags;
   createInfo.subresourceRange.baseMipLevel = 0;
-  createInfo.subresourceRange.levelCount = 1;
+  createInfo.subresourceRange.levelCount = mipLevels;
   createInfo.subresourceRange.baseArrayLayer = 0;
   createInfo.subresourceRange.layerCount = 1;
 
@@ -1730,7 +3338,9 @@ void createTextureSampler() {
   samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   samplerInfo.mipLodBias = 0.0f;
   samplerInfo.minLod = 0.0f;
-  samplerInfo.maxLod = 0.0f;
+  // not tied to the texture's level count, so the sampler stays valid as
+  // textures are streamed in and replaced
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
   if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
     throw std::runtime_error("failed to create texture sampler!");
@@ -1773,18 +3383,18 @@ void createDepthResources() {
   createImage(
     swapChainExtent.width,
     swapChainExtent.height,
+    1,
     depthFormat,
     VK_IMAGE_TILING_OPTIMAL,
     VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    MemoryUsage::GpuOnly,
     depthImage,
     depthImageMemory);
-  depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+  depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 
-  transitionImageLayout(depthImage,
-    depthFormat,
-    VK_IMAGE_LAYOUT_UNDEFINED,
-    VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+  // no transition here: the render pass takes the depth attachment from
+  // the undefined layout in each frame's command buffer, so a resize does
+  // not wait for the queue to go idle
 }
 
 void initWindow() {
@@ -1799,6 +3409,9 @@ void initWindow() {
 }
 
 void initVulkan() {
+  initStartTime = std::chrono::high_resolution_clock::now();
+  startAssetStreaming();
+
   initWindow();
 
   createInstance();
@@ -1806,61 +3419,73 @@ void initVulkan() {
   createSurface();
   pickPhysicalDevice();
   createLogicalDevice();
+  deviceAllocator.emplace(physicalDevice, device, supportsMemoryBudget(physicalDevice));
+  createPipelineCache();
+  pipelineCompiler.emplace(device, pipelineCache);
   createSwapChain();
   createImageViews();
   createRenderPass();
   createDescriptorSetLayout();
   createGraphicsPipeline();
   createCommandPool();
+  createStagingRing();
 
   createDepthResources();
   createFramebuffers();
 
-  createTextureImage();
-  createTextureImageView();
   createTextureSampler();
-
-  createIndexBuffer();
-  createVertexBuffer();
-  createUniformBuffers();
-
+  createUniformArena();
   createDescriptorPool();
-  createDescriptorSets();
+  createUniformDescriptorSet();
+
+  createPlaceholders();
 
   createCommandBuffers();
 
   createSyncObjects();
+
+  logDeviceMemory();
 }
 
 void mainLoop() {
+  bool firstFrame = true;
   while (!glfwWindowShouldClose(window)) {
     glfwPollEvents();
     drawFrame();
+
+    if (firstFrame) {
+      auto firstFrameTime = std::chrono::high_resolution_clock::now();
+      std::cout << "first frame after "
+        << std::chrono::duration<float, std::chrono::milliseconds::period>(firstFrameTime - initStartTime).count()
+        << " ms" << std::endl;
+      firstFrame = false;
+    }
   }
 
   vkDeviceWaitIdle(device);
 }
 
 void cleanup() {
-  cleanupSwapChain();
+  finishUploads();
+  releaseAllRetired();
+  logDeviceMemory();
 
-  vkDestroyImageView(device, depthImageView, nullptr);
-  vkDestroyImage(device, depthImage, nullptr);
-  vkFreeMemory(device, depthImageMemory, nullptr);
+  freeCommandBuffers();
+  cleanupSwapChain();
+  cleanupRenderPipelines();
 
+  cleanupModelTexture();
+  cleanupTexture(placeholderTexture);
+  logTextureResidency();
   vkDestroySampler(device, textureSampler, nullptr);
 
-  vkDestroyImageView(device, textureImageView, nullptr);
-  vkDestroyImage(device, textureImage, nullptr);
-  vkFreeMemory(device, textureImageMemory, nullptr);
-
+  vkDestroyBuffer(device, uniformArena.buffer, nullptr);
+  deviceAllocator->free(uniformArena.memory);
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
   vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+  vkDestroyDescriptorSetLayout(device, textureSetLayout, nullptr);
 
-  vkDestroyBuffer(device, vertexBuffer, nullptr);
-  vkFreeMemory(device, vertexBufferMemory, nullptr);
-
-  vkDestroyBuffer(device, indexBuffer, nullptr);
-  vkFreeMemory(device, indexBufferMemory, nullptr);
+  cleanupModelBuffers(modelBuffers);
 
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
     vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
@@ -1868,6 +3493,13 @@ void cleanup() {
     vkDestroyFence(device, inFlightFences[i], nullptr);
   }
   vkDestroyCommandPool(device, commandPool, nullptr);
+  vkDestroyCommandPool(device, transferCommandPool, nullptr);
+  cleanupStagingRing();
+  deviceAllocator.reset();
+
+  pipelineCompiler.reset();
+  savePipelineCache();
+  vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
   if (enableValidationLayers) {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
@@ -0,0 +1,181 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename) {
+  HANDLE file = CreateFileA(
+    filename.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    nullptr,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+    nullptr);
+
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("failed to open file!");
+  }
+  fileHandle = file;
+  fileOpen = true;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    close();
+    throw std::runtime_error("failed to query file size!");
+  }
+  mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+  // zero-length files cannot be mapped, they are simply empty
+  if (mappedSize == 0) {
+    return;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    close();
+    throw std::runtime_error("failed to map file!");
+  }
+  mappingHandle = mapping;
+
+  mappedData = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (mappedData == nullptr) {
+    close();
+    throw std::runtime_error("failed to map file!");
+  }
+}
+
+void MappedFile::close() {
+  if (mappedData != nullptr) {
+    UnmapViewOfFile(mappedData);
+  }
+  if (mappingHandle != nullptr) {
+    CloseHandle(mappingHandle);
+  }
+  if (fileHandle != nullptr) {
+    CloseHandle(fileHandle);
+  }
+
+  mappedData = nullptr;
+  mappedSize = 0;
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+  fileOpen = false;
+}
+
+void MappedFile::adviseSequential() const {
+  // the file is opened with FILE_FLAG_SEQUENTIAL_SCAN already
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : mappedData(std::exchange(other.mappedData, nullptr)),
+    mappedSize(std::exchange(other.mappedSize, 0)),
+    fileOpen(std::exchange(other.fileOpen, false)),
+    fileHandle(std::exchange(other.fileHandle, nullptr)),
+    mappingHandle(std::exchange(other.mappingHandle, nullptr))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    close();
+    mappedData = std::exchange(other.mappedData, nullptr);
+    mappedSize = std::exchange(other.mappedSize, 0);
+    fileOpen = std::exchange(other.fileOpen, false);
+    fileHandle = std::exchange(other.fileHandle, nullptr);
+    mappingHandle = std::exchange(other.mappingHandle, nullptr);
+  }
+  return *this;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+  fileDescriptor = ::open(filename.c_str(), O_RDONLY);
+  if (fileDescriptor < 0) {
+    throw std::runtime_error("failed to open file!");
+  }
+  fileOpen = true;
+
+  struct stat fileStat;
+  if (fstat(fileDescriptor, &fileStat) != 0) {
+    close();
+    throw std::runtime_error("failed to query file size!");
+  }
+  mappedSize = static_cast<size_t>(fileStat.st_size);
+
+  // zero-length files cannot be mapped, they are simply empty
+  if (mappedSize == 0) {
+    return;
+  }
+
+  void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+  if (mapping == MAP_FAILED) {
+    close();
+    throw std::runtime_error("failed to map file!");
+  }
+  mappedData = static_cast<const char*>(mapping);
+}
+
+void MappedFile::close() {
+  if (mappedData != nullptr) {
+    munmap(const_cast<char*>(mappedData), mappedSize);
+  }
+  if (fileDescriptor >= 0) {
+    ::close(fileDescriptor);
+  }
+
+  mappedData = nullptr;
+  mappedSize = 0;
+  fileDescriptor = -1;
+  fileOpen = false;
+}
+
+void MappedFile::adviseSequential() const {
+  if (mappedData == nullptr) {
+    return;
+  }
+
+  // both are only hints, failing them is harmless
+  void* mapping = const_cast<char*>(mappedData);
+  posix_madvise(mapping, mappedSize, POSIX_MADV_SEQUENTIAL);
+  posix_madvise(mapping, mappedSize, POSIX_MADV_WILLNEED);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : mappedData(std::exchange(other.mappedData, nullptr)),
+    mappedSize(std::exchange(other.mappedSize, 0)),
+    fileOpen(std::exchange(other.fileOpen, false)),
+    fileDescriptor(std::exchange(other.fileDescriptor, -1))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    close();
+    mappedData = std::exchange(other.mappedData, nullptr);
+    mappedSize = std::exchange(other.mappedSize, 0);
+    fileOpen = std::exchange(other.fileOpen, false);
+    fileDescriptor = std::exchange(other.fileDescriptor, -1);
+  }
+  return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+  close();
+}
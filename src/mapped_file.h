@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into the address space. The mapping
+// lives as long as the object, so pointers into data() must not outlive it.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  // Hints that the mapping is about to be read front to back once, so the
+  // kernel reads ahead aggressively and drops pages behind the reader.
+  void adviseSequential() const;
+
+  const char* data() const { return mappedData; }
+  size_t size() const { return mappedSize; }
+  bool isOpen() const { return fileOpen; }
+
+private:
+  void close();
+
+  const char* mappedData = nullptr;
+  size_t mappedSize = 0;
+  bool fileOpen = false;
+
+#ifdef _WIN32
+  void* fileHandle = nullptr;
+  void* mappingHandle = nullptr;
+#else
+  int fileDescriptor = -1;
+#endif
+};
@@ -0,0 +1,110 @@
+#include "mesh_builder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+
+namespace {
+
+// Vertex has no normal, so only the position and texture coordinate indices
+// take part in the key. Both are packed into one 64-bit word; the texture
+// coordinate is stored off by one so that a missing one (-1) becomes zero.
+const uint64_t emptyKey = UINT64_MAX;
+
+struct DedupSlot {
+  uint64_t key;
+  uint32_t vertex;
+  uint32_t padding; // keeps slots at 16 bytes, four to a cache line
+};
+
+uint64_t dedupKey(const ObjIndex& index) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(index.position)) << 32)
+    | static_cast<uint32_t>(index.texCoord + 1);
+}
+
+uint32_t tableBits(size_t entries) {
+  // keep the load factor at or below one half
+  uint32_t bits = 4;
+  while ((size_t(1) << bits) < entries * 2) {
+    bits++;
+  }
+  return bits;
+}
+
+void dedupShape(const ObjMesh& obj, const ObjShape& shape, MeshData& result) {
+  const uint32_t bits = tableBits(shape.indexCount);
+  const size_t mask = (size_t(1) << bits) - 1;
+  std::vector<DedupSlot> table(mask + 1, DedupSlot{ emptyKey, 0, 0 });
+
+  result.indices.resize(shape.indexCount);
+  result.vertices.reserve(shape.indexCount / 2);
+
+  for (uint32_t i = 0; i < shape.indexCount; i++) {
+    const ObjIndex& index = obj.indices[shape.firstIndex + i];
+    const uint64_t key = dedupKey(index);
+
+    // Fibonacci hashing spreads neighbouring indices across the table
+    size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+    while (table[slot].key != emptyKey && table[slot].key != key) {
+      slot = (slot + 1) & mask;
+    }
+
+    if (table[slot].key == emptyKey) {
+      table[slot].key = key;
+      table[slot].vertex = static_cast<uint32_t>(result.vertices.size());
+      result.vertices.push_back(makeObjVertex(obj, index));
+    }
+
+    result.indices[i] = table[slot].vertex;
+  }
+}
+
+} // namespace
+
+MeshData buildMesh(const ObjMesh& obj, unsigned int threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  std::vector<MeshData> shapes(obj.shapes.size());
+  std::atomic<size_t> nextShape{0};
+
+  auto worker = [&]() {
+    for (size_t i = nextShape++; i < shapes.size(); i = nextShape++) {
+      dedupShape(obj, obj.shapes[i], shapes[i]);
+    }
+  };
+
+  // the calling thread works too, so one thread means no extra threads at all
+  std::vector<std::future<void>> workers;
+  size_t workerCount = std::min<size_t>(threadCount, shapes.size());
+  for (size_t i = 1; i < workerCount; i++) {
+    workers.push_back(std::async(std::launch::async, worker));
+  }
+  worker();
+  for (auto& task : workers) {
+    task.get();
+  }
+
+  MeshData mesh;
+
+  size_t vertexCount = 0;
+  size_t indexCount = 0;
+  for (const auto& shape : shapes) {
+    vertexCount += shape.vertices.size();
+    indexCount += shape.indices.size();
+  }
+  mesh.vertices.reserve(vertexCount);
+  mesh.indices.reserve(indexCount);
+
+  for (const auto& shape : shapes) {
+    uint32_t baseVertex = static_cast<uint32_t>(mesh.vertices.size());
+    mesh.vertices.insert(mesh.vertices.end(), shape.vertices.begin(), shape.vertices.end());
+    for (uint32_t index : shape.indices) {
+      mesh.indices.push_back(baseVertex + index);
+    }
+  }
+
+  return mesh;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "obj_loader.h"
+#include "vertex.h"
+
+#include <cstdint>
+#include <vector>
+
+// Indexed triangle list ready for createVertexBuffer/createIndexBuffer.
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+// Turns OBJ corners into a compact indexed mesh. Corners that reference the
+// same position/texture coordinate pair share one vertex; the lookup is an
+// open-addressing hash table per shape, and shapes are processed on up to
+// threadCount threads (0 uses every hardware thread). Vertices are never
+// shared between shapes, and the triangle order of the input is preserved.
+MeshData buildMesh(const ObjMesh& obj, unsigned int threadCount = 0);
@@ -0,0 +1,190 @@
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+const char meshCacheMagic[4] = { 'V', 'K', 'P', 'M' };
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool fitsInFile(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize) {
+  return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+}
+
+int64_t modifiedTime(const std::string& path) {
+  return static_cast<int64_t>(std::filesystem::last_write_time(path).time_since_epoch().count());
+}
+
+void writePadding(std::ofstream& file, uint64_t offset) {
+  static const char zeros[meshCacheAlignment] = {};
+  uint64_t position = static_cast<uint64_t>(file.tellp());
+  file.write(zeros, static_cast<std::streamsize>(offset - position));
+}
+
+} // namespace
+
+std::optional<MeshCache> MeshCache::open(const std::string& sourcePath) {
+  std::string cachePath = meshCachePath(sourcePath);
+  if (!std::filesystem::exists(cachePath)) {
+    return std::nullopt;
+  }
+
+  return open(sourcePath, MappedFile(cachePath));
+}
+
+std::optional<MeshCache> MeshCache::open(const std::string& sourcePath, MappedFile&& file) {
+  if (file.size() < sizeof(MeshCacheHeader)) {
+    return std::nullopt;
+  }
+
+  MeshCacheHeader header;
+  memcpy(&header, file.data(), sizeof(header));
+
+  bool current = memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) == 0
+    && header.version == meshCacheVersion
+    && header.vertexFormat <= static_cast<uint32_t>(VertexFormat::Half)
+    && (header.indexSize == 2 || header.indexSize == 4)
+    && header.sourceSize == std::filesystem::file_size(sourcePath)
+    && header.sourceModifiedTime == modifiedTime(sourcePath);
+  if (!current) {
+    return std::nullopt;
+  }
+
+  VertexInputLayout layout = vertexInputLayout(static_cast<VertexFormat>(header.vertexFormat));
+  current = header.positionSize == header.vertexCount * layout.bindings[0].stride
+    && header.attributeSize == header.vertexCount * layout.bindings[1].stride
+    && fitsInFile(header.positionOffset, header.positionSize, 1, file.size())
+    && fitsInFile(header.attributeOffset, header.attributeSize, 1, file.size())
+    && fitsInFile(header.indexOffset, header.indexCount, header.indexSize, file.size())
+    && fitsInFile(header.submeshOffset, header.submeshCount, sizeof(Submesh), file.size());
+
+  if (!current) {
+    return std::nullopt;
+  }
+
+  return MeshCache(std::move(file));
+}
+
+const MeshCacheHeader& MeshCache::header() const {
+  return *reinterpret_cast<const MeshCacheHeader*>(file.data());
+}
+
+VertexFormat MeshCache::vertexFormat() const {
+  return static_cast<VertexFormat>(header().vertexFormat);
+}
+
+const void* MeshCache::positionData() const {
+  return file.data() + header().positionOffset;
+}
+
+size_t MeshCache::positionDataSize() const {
+  return static_cast<size_t>(header().positionSize);
+}
+
+const void* MeshCache::attributeData() const {
+  return file.data() + header().attributeOffset;
+}
+
+size_t MeshCache::attributeDataSize() const {
+  return static_cast<size_t>(header().attributeSize);
+}
+
+const void* MeshCache::indexData() const {
+  return file.data() + header().indexOffset;
+}
+
+size_t MeshCache::indexDataSize() const {
+  return static_cast<size_t>(header().indexCount * header().indexSize);
+}
+
+std::vector<Submesh> MeshCache::submeshes() const {
+  std::vector<Submesh> result(static_cast<size_t>(header().submeshCount));
+  memcpy(result.data(), file.data() + header().submeshOffset, result.size() * sizeof(Submesh));
+  return result;
+}
+
+std::string meshCachePath(const std::string& sourcePath) {
+  return sourcePath + ".vkmesh";
+}
+
+void writeMeshCache(const std::string& sourcePath, const PackedMesh& mesh, const UploadVertices& vertices) {
+  writeMeshCache(sourcePath, meshCachePath(sourcePath), mesh, vertices);
+}
+
+void writeMeshCache(
+  const std::string& sourcePath,
+  const std::string& cachePath,
+  const PackedMesh& mesh,
+  const UploadVertices& vertices)
+{
+  MeshCacheHeader header{};
+  memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+  header.version = meshCacheVersion;
+  header.sourceSize = std::filesystem::file_size(sourcePath);
+  header.sourceModifiedTime = modifiedTime(sourcePath);
+
+  header.vertexFormat = static_cast<uint32_t>(vertices.format);
+  header.indexSize = mesh.indexSize;
+  header.vertexCount = vertices.vertexCount;
+  header.indexCount = mesh.indexCount;
+  header.submeshCount = mesh.submeshes.size();
+  header.dequantization = vertices.dequantization;
+  header.positionSize = vertices.streams.positions.size();
+  header.attributeSize = vertices.streams.attributes.size();
+  header.positionOffset = alignUp(sizeof(MeshCacheHeader), meshCacheAlignment);
+  header.attributeOffset = alignUp(header.positionOffset + header.positionSize, meshCacheAlignment);
+  header.indexOffset = alignUp(header.attributeOffset + header.attributeSize, meshCacheAlignment);
+  header.submeshOffset = alignUp(
+    header.indexOffset + header.indexCount * header.indexSize,
+    meshCacheAlignment);
+
+  glm::vec3 boundsMin(0.0f);
+  glm::vec3 boundsMax(0.0f);
+  if (!mesh.vertices.empty()) {
+    boundsMin = boundsMax = mesh.vertices[0].pos;
+    for (const auto& vertex : mesh.vertices) {
+      boundsMin = glm::min(boundsMin, vertex.pos);
+      boundsMax = glm::max(boundsMax, vertex.pos);
+    }
+  }
+  memcpy(header.boundsMin, &boundsMin, sizeof(header.boundsMin));
+  memcpy(header.boundsMax, &boundsMax, sizeof(header.boundsMax));
+
+  std::string temporaryPath = cachePath + ".tmp";
+
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to create mesh cache!");
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    writePadding(file, header.positionOffset);
+    file.write(vertices.streams.positions.data(), static_cast<std::streamsize>(header.positionSize));
+
+    writePadding(file, header.attributeOffset);
+    file.write(vertices.streams.attributes.data(), static_cast<std::streamsize>(header.attributeSize));
+
+    writePadding(file, header.indexOffset);
+    file.write(mesh.indexData.data(), static_cast<std::streamsize>(mesh.indexData.size()));
+
+    writePadding(file, header.submeshOffset);
+    file.write(
+      reinterpret_cast<const char*>(mesh.submeshes.data()),
+      static_cast<std::streamsize>(mesh.submeshes.size() * sizeof(Submesh)));
+
+    if (!file) {
+      throw std::runtime_error("failed to write mesh cache!");
+    }
+  }
+
+  std::filesystem::rename(temporaryPath, cachePath);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "index_packing.h"
+#include "vertex_streams.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Binary mesh cache layout (version 3), all values little endian:
+//
+//   MeshCacheHeader
+//   position stream at positionOffset:    positionSize bytes
+//   attribute stream at attributeOffset:  attributeSize bytes
+//   index blob at indexOffset:            indexCount * indexSize bytes
+//   submesh table at submeshOffset:       submeshCount Submesh entries
+//
+// The vertex streams are stored as uploaded, already quantized for
+// vertexFormat and split, so a hit needs no processing at all. The blobs
+// start on a meshCacheAlignment boundary so they can be copied straight out
+// of the mapping into a staging buffer.
+const uint32_t meshCacheVersion = 3;
+const uint64_t meshCacheAlignment = 64;
+
+struct MeshCacheHeader {
+  char magic[4];
+  uint32_t version;
+
+  // the source file the cache was built from, to detect stale caches
+  uint64_t sourceSize;
+  int64_t sourceModifiedTime;
+
+  uint32_t vertexFormat; // VertexFormat
+  uint32_t indexSize;
+  uint64_t vertexCount;
+  uint64_t indexCount;
+  uint64_t positionOffset;
+  uint64_t positionSize;
+  uint64_t attributeOffset;
+  uint64_t attributeSize;
+  uint64_t indexOffset;
+  uint64_t submeshCount;
+  uint64_t submeshOffset;
+  VertexDequantization dequantization;
+
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+class MeshCache {
+public:
+  // Maps the cache for sourcePath if it exists and is still current.
+  static std::optional<MeshCache> open(const std::string& sourcePath);
+  // The same with the cache already mapped, e.g. by an I/O thread.
+  static std::optional<MeshCache> open(const std::string& sourcePath, MappedFile&& file);
+
+  const MeshCacheHeader& header() const;
+
+  VertexFormat vertexFormat() const;
+  const void* positionData() const;
+  size_t positionDataSize() const;
+  const void* attributeData() const;
+  size_t attributeDataSize() const;
+  const void* indexData() const;
+  size_t indexDataSize() const;
+  std::vector<Submesh> submeshes() const;
+
+private:
+  explicit MeshCache(MappedFile&& mappedFile) : file(std::move(mappedFile)) {}
+
+  MappedFile file;
+};
+
+// Where the cache for a source file lives: right next to it.
+std::string meshCachePath(const std::string& sourcePath);
+
+// Writes the indices and submeshes packIndices chose for mesh, and vertices
+// as prepared from its vertices, as the cache of sourcePath. The file is
+// written under a temporary name and renamed into place, so readers never
+// see half a cache.
+void writeMeshCache(const std::string& sourcePath, const PackedMesh& mesh, const UploadVertices& vertices);
+// The same to cachePath instead of next to sourcePath.
+void writeMeshCache(
+  const std::string& sourcePath,
+  const std::string& cachePath,
+  const PackedMesh& mesh,
+  const UploadVertices& vertices);
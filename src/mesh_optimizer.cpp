@@ -0,0 +1,297 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Triangle lists of every vertex, stored compactly: the triangles of vertex v
+// are triangles[offsets[v]] up to triangles[offsets[v + 1]].
+struct VertexAdjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+};
+
+VertexAdjacency buildAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount) {
+  VertexAdjacency adjacency;
+  adjacency.offsets.assign(vertexCount + 1, 0);
+  adjacency.triangles.resize(indices.size());
+
+  for (uint32_t index : indices) {
+    adjacency.offsets[index + 1]++;
+  }
+  std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+  std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+  for (size_t i = 0; i < indices.size(); i++) {
+    adjacency.triangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  return adjacency;
+}
+
+const int64_t noVertex = -1;
+
+// Returns a vertex that still has live triangles, preferring the most recent
+// dead-end vertices, then scanning forward through the input order.
+int64_t skipDeadEnd(
+  const std::vector<uint32_t>& liveTriangles,
+  std::vector<uint32_t>& deadEnds,
+  size_t& cursor)
+{
+  while (!deadEnds.empty()) {
+    uint32_t vertex = deadEnds.back();
+    deadEnds.pop_back();
+    if (liveTriangles[vertex] > 0) {
+      return vertex;
+    }
+  }
+
+  for (; cursor < liveTriangles.size(); cursor++) {
+    if (liveTriangles[cursor] > 0) {
+      return static_cast<int64_t>(cursor);
+    }
+  }
+
+  return noVertex;
+}
+
+// Whether a triangle misses the FIFO cache on all three vertices, which is
+// where a cache-optimized ordering has restarted somewhere else on the mesh.
+bool restartsCache(
+  const uint32_t* triangle,
+  std::vector<uint64_t>& cacheTime,
+  uint64_t& time,
+  uint32_t cacheSize)
+{
+  int misses = 0;
+  for (int corner = 0; corner < 3; corner++) {
+    uint32_t vertex = triangle[corner];
+    if (time - cacheTime[vertex] >= cacheSize) {
+      cacheTime[vertex] = time++;
+      misses++;
+    }
+  }
+  return misses == 3;
+}
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(
+  const std::vector<uint32_t>& indices,
+  size_t vertexCount,
+  uint32_t cacheSize)
+{
+  std::vector<uint32_t> cache;
+  std::vector<bool> inCache(vertexCount, false);
+  std::vector<bool> referenced(vertexCount, false);
+  size_t cacheHead = 0;
+  size_t misses = 0;
+  size_t uniqueVertices = 0;
+
+  for (uint32_t index : indices) {
+    if (!referenced[index]) {
+      referenced[index] = true;
+      uniqueVertices++;
+    }
+
+    if (inCache[index]) {
+      continue;
+    }
+    misses++;
+
+    // FIFO: a hit does not refresh the entry, a miss evicts the oldest
+    if (cache.size() < cacheSize) {
+      cache.push_back(index);
+    } else {
+      inCache[cache[cacheHead]] = false;
+      cache[cacheHead] = index;
+      cacheHead = (cacheHead + 1) % cacheSize;
+    }
+    inCache[index] = true;
+  }
+
+  VertexCacheStats stats{};
+  if (!indices.empty()) {
+    stats.acmr = misses / (indices.size() / 3.0f);
+    stats.atvr = misses / static_cast<float>(uniqueVertices);
+  }
+  return stats;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  VertexAdjacency adjacency = buildAdjacency(indices, vertexCount);
+
+  std::vector<uint32_t> liveTriangles(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  }
+
+  // cacheTime[v] is the timestamp at which v last entered the simulated cache
+  std::vector<uint64_t> cacheTime(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> deadEnds;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+
+  uint64_t time = cacheSize + 1;
+  size_t cursor = 0;
+  int64_t fanning = skipDeadEnd(liveTriangles, deadEnds, cursor);
+
+  while (fanning != noVertex) {
+    candidates.clear();
+
+    // emit every remaining triangle around the fanning vertex
+    for (uint32_t t = adjacency.offsets[fanning]; t < adjacency.offsets[fanning + 1]; t++) {
+      uint32_t triangle = adjacency.triangles[t];
+      if (emitted[triangle]) {
+        continue;
+      }
+
+      for (int corner = 0; corner < 3; corner++) {
+        uint32_t vertex = indices[triangle * 3 + corner];
+        output.push_back(vertex);
+        deadEnds.push_back(vertex);
+        candidates.push_back(vertex);
+        liveTriangles[vertex]--;
+
+        if (time - cacheTime[vertex] > cacheSize) {
+          cacheTime[vertex] = time++;
+        }
+      }
+      emitted[triangle] = true;
+    }
+
+    // continue with the candidate that will still be in the cache after its
+    // own fan has been emitted, favouring the one that entered it earliest
+    int64_t next = noVertex;
+    uint64_t bestPriority = 0;
+    for (uint32_t vertex : candidates) {
+      if (liveTriangles[vertex] == 0) {
+        continue;
+      }
+
+      uint64_t priority = 0;
+      if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+        priority = time - cacheTime[vertex];
+      }
+
+      if (next == noVertex || priority > bestPriority) {
+        bestPriority = priority;
+        next = vertex;
+      }
+    }
+
+    fanning = next != noVertex ? next : skipDeadEnd(liveTriangles, deadEnds, cursor);
+  }
+
+  indices = std::move(output);
+}
+
+void optimizeOverdraw(
+  std::vector<uint32_t>& indices,
+  const std::vector<Vertex>& vertices,
+  uint32_t cacheSize)
+{
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // cluster boundaries, as first triangle of each cluster
+  std::vector<size_t> clusterStarts;
+  std::vector<uint64_t> cacheTime(vertices.size(), 0);
+  uint64_t time = cacheSize;
+  for (size_t t = 0; t < triangleCount; t++) {
+    if (restartsCache(&indices[t * 3], cacheTime, time, cacheSize) || t == 0) {
+      clusterStarts.push_back(t);
+    }
+  }
+  clusterStarts.push_back(triangleCount);
+
+  size_t clusterCount = clusterStarts.size() - 1;
+  std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+  std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+
+  for (size_t c = 0; c < clusterCount; c++) {
+    float clusterArea = 0.0f;
+
+    for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+      const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+      const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+      const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+
+      // the cross product's length is twice the area, its direction the normal
+      glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      float area = glm::length(normal);
+      glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+      clusterCentroids[c] += centroid * area;
+      clusterNormals[c] += normal;
+      clusterArea += area;
+    }
+
+    meshCentroid += clusterCentroids[c];
+    meshArea += clusterArea;
+    if (clusterArea > 0.0f) {
+      clusterCentroids[c] = clusterCentroids[c] / clusterArea;
+    }
+  }
+  if (meshArea > 0.0f) {
+    meshCentroid = meshCentroid / meshArea;
+  }
+
+  // clusters facing away from the centre occlude the ones facing inwards
+  std::vector<float> sortKeys(clusterCount);
+  for (size_t c = 0; c < clusterCount; c++) {
+    sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+  }
+
+  std::vector<size_t> order(clusterCount);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sortKeys[a] > sortKeys[b];
+  });
+
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+  for (size_t c : order) {
+    output.insert(
+      output.end(),
+      indices.begin() + clusterStarts[c] * 3,
+      indices.begin() + clusterStarts[c + 1] * 3);
+  }
+
+  indices = std::move(output);
+}
+
+void optimizeVertexFetch(MeshData& mesh) {
+  const uint32_t unassigned = UINT32_MAX;
+  std::vector<uint32_t> remap(mesh.vertices.size(), unassigned);
+  std::vector<Vertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+
+  for (uint32_t& index : mesh.indices) {
+    if (remap[index] == unassigned) {
+      remap[index] = static_cast<uint32_t>(vertices.size());
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  mesh.vertices = std::move(vertices);
+}
+
+void optimizeMesh(MeshData& mesh) {
+  optimizeVertexCache(mesh.indices, mesh.vertices.size());
+  optimizeOverdraw(mesh.indices, mesh.vertices);
+  optimizeVertexFetch(mesh);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "mesh_builder.h"
+
+#include <cstdint>
+#include <vector>
+
+// FIFO post-transform cache size assumed by the optimizer and the statistics.
+// Hardware differs, but orderings tuned for 16 entries hold up on all of it.
+const uint32_t vertexCacheSize = 16;
+
+struct VertexCacheStats {
+  float acmr; // average cache miss ratio: shaded vertices per triangle
+  float atvr; // average transformed vertex ratio: shaded vertices per unique vertex
+};
+
+// Simulates a FIFO cache of cacheSize entries over the index buffer.
+VertexCacheStats analyzeVertexCache(
+  const std::vector<uint32_t>& indices,
+  size_t vertexCount,
+  uint32_t cacheSize = vertexCacheSize);
+
+// Reorders triangles for the post-transform cache (Tipsify, Sander et al.
+// 2007). Works in linear time and never changes the set of triangles.
+void optimizeVertexCache(
+  std::vector<uint32_t>& indices,
+  size_t vertexCount,
+  uint32_t cacheSize = vertexCacheSize);
+
+// Splits a cache-optimized index buffer into clusters at cache restarts and
+// sorts the clusters so that outward-facing ones draw first, which reduces
+// overdraw from most viewpoints while keeping the cache behaviour.
+void optimizeOverdraw(
+  std::vector<uint32_t>& indices,
+  const std::vector<Vertex>& vertices,
+  uint32_t cacheSize = vertexCacheSize);
+
+// Renumbers vertices in the order the index buffer first references them, so
+// vertex fetch walks memory linearly. Unreferenced vertices are dropped.
+void optimizeVertexFetch(MeshData& mesh);
+
+// All of the above, in the order they have to run.
+void optimizeMesh(MeshData& mesh);
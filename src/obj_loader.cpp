@@ -0,0 +1,437 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// chunks smaller than this are not worth a thread of their own
+const size_t minChunkSize = 1 << 20;
+
+// Face indices inside a chunk are stored in this form until the chunks are
+// merged: absolute indices as-is, relative (negative) OBJ indices as an
+// offset into the chunk's own attribute arrays, biased below zero.
+const int32_t missingIndex = INT32_MIN;
+const int32_t chunkLocalBias = 1 << 30;
+
+struct ObjChunk {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> colors;
+  std::vector<glm::vec2> texCoords;
+  std::vector<glm::vec3> normals;
+  std::vector<ObjIndex> indices;
+  std::vector<ObjShape> shapes;
+  bool hasColors = false;
+};
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+void skipSpaces(const char*& p, const char* end) {
+  while (p < end && isSpace(*p)) {
+    p++;
+  }
+}
+
+double powerOfTen(int exponent) {
+  static const double table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+
+  if (exponent >= 0 && exponent <= 22) {
+    return table[exponent];
+  }
+  if (exponent < 0 && exponent >= -22) {
+    return 1.0 / table[-exponent];
+  }
+  return std::pow(10.0, exponent);
+}
+
+// Locale-independent replacement for strtof that never reads past end.
+bool parseFloat(const char*& p, const char* end, float& value) {
+  skipSpaces(p, end);
+  const char* start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+
+  for (; p < end && isDigit(*p); p++, digits++) {
+    if (mantissa < 100000000000000000ull) {
+      mantissa = mantissa * 10 + (*p - '0');
+    } else {
+      exponent++;
+    }
+  }
+
+  if (p < end && *p == '.') {
+    p++;
+    for (; p < end && isDigit(*p); p++, digits++) {
+      if (mantissa < 100000000000000000ull) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+    }
+  }
+
+  if (digits == 0) {
+    p = start;
+    return false;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* exponentStart = p;
+    p++;
+
+    bool negativeExponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negativeExponent = *p == '-';
+      p++;
+    }
+
+    if (p < end && isDigit(*p)) {
+      int explicitExponent = 0;
+      for (; p < end && isDigit(*p); p++) {
+        explicitExponent = std::min(explicitExponent * 10 + (*p - '0'), 9999);
+      }
+      exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    } else {
+      p = exponentStart;
+    }
+  }
+
+  double result = static_cast<double>(mantissa) * powerOfTen(exponent);
+  value = static_cast<float>(negative ? -result : result);
+  return true;
+}
+
+bool parseInt(const char*& p, const char* end, int64_t& value) {
+  const char* start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  int64_t result = 0;
+  int digits = 0;
+  for (; p < end && isDigit(*p); p++, digits++) {
+    result = std::min<int64_t>(result * 10 + (*p - '0'), INT32_MAX);
+  }
+
+  if (digits == 0) {
+    p = start;
+    return false;
+  }
+
+  value = negative ? -result : result;
+  return true;
+}
+
+int32_t encodeIndex(int64_t objIndex, size_t localCount) {
+  if (objIndex > 0 && objIndex <= chunkLocalBias) {
+    return static_cast<int32_t>(objIndex - 1);
+  }
+
+  int64_t local = static_cast<int64_t>(localCount) + objIndex;
+  if (objIndex < 0 && local > -chunkLocalBias && local < chunkLocalBias) {
+    return static_cast<int32_t>(local - chunkLocalBias);
+  }
+
+  throw std::runtime_error("obj face index out of range!");
+}
+
+int32_t resolveIndex(int32_t encoded, size_t chunkBase, size_t totalCount) {
+  if (encoded == missingIndex) {
+    return -1;
+  }
+
+  int64_t index = encoded;
+  if (encoded < 0) {
+    index = static_cast<int64_t>(chunkBase) + encoded + chunkLocalBias;
+  }
+
+  if (index < 0 || index >= static_cast<int64_t>(totalCount)) {
+    throw std::runtime_error("obj face index out of range!");
+  }
+
+  return static_cast<int32_t>(index);
+}
+
+// Parses one face corner: v, v/vt, v//vn or v/vt/vn.
+bool parseCorner(const char*& p, const char* end, const ObjChunk& chunk, ObjIndex& corner) {
+  skipSpaces(p, end);
+
+  int64_t value;
+  if (!parseInt(p, end, value)) {
+    return false;
+  }
+  corner.position = encodeIndex(value, chunk.positions.size());
+  corner.texCoord = missingIndex;
+  corner.normal = missingIndex;
+
+  if (p < end && *p == '/') {
+    p++;
+    if (parseInt(p, end, value)) {
+      corner.texCoord = encodeIndex(value, chunk.texCoords.size());
+    }
+
+    if (p < end && *p == '/') {
+      p++;
+      if (parseInt(p, end, value)) {
+        corner.normal = encodeIndex(value, chunk.normals.size());
+      }
+    }
+  }
+
+  if (p < end && !isSpace(*p)) {
+    throw std::runtime_error("malformed obj face!");
+  }
+
+  return true;
+}
+
+void parseLine(const char* p, const char* end, ObjChunk& chunk, std::vector<ObjIndex>& face) {
+  skipSpaces(p, end);
+  if (p + 1 >= end) {
+    return;
+  }
+
+  if (p[0] == 'v' && isSpace(p[1])) {
+    p++;
+    float values[6];
+    int count = 0;
+    while (count < 6 && parseFloat(p, end, values[count])) {
+      count++;
+    }
+    if (count < 3) {
+      throw std::runtime_error("malformed obj vertex!");
+    }
+
+    chunk.positions.push_back(glm::vec3(values[0], values[1], values[2]));
+    if (count == 6) {
+      chunk.colors.push_back(glm::vec3(values[3], values[4], values[5]));
+      chunk.hasColors = true;
+    } else {
+      chunk.colors.push_back(glm::vec3(1.0f, 1.0f, 1.0f));
+    }
+  }
+  else if (p[0] == 'v' && p[1] == 't') {
+    p += 2;
+    glm::vec2 texCoord(0.0f, 0.0f);
+    if (!parseFloat(p, end, texCoord.x)) {
+      throw std::runtime_error("malformed obj texture coordinate!");
+    }
+    parseFloat(p, end, texCoord.y);
+    chunk.texCoords.push_back(texCoord);
+  }
+  else if (p[0] == 'v' && p[1] == 'n') {
+    p += 2;
+    glm::vec3 normal;
+    if (!parseFloat(p, end, normal.x) || !parseFloat(p, end, normal.y) || !parseFloat(p, end, normal.z)) {
+      throw std::runtime_error("malformed obj normal!");
+    }
+    chunk.normals.push_back(normal);
+  }
+  else if (p[0] == 'f' && isSpace(p[1])) {
+    p++;
+    face.clear();
+
+    ObjIndex corner;
+    while (parseCorner(p, end, chunk, corner)) {
+      face.push_back(corner);
+    }
+
+    for (size_t i = 1; i + 1 < face.size(); i++) {
+      chunk.indices.push_back(face[0]);
+      chunk.indices.push_back(face[i]);
+      chunk.indices.push_back(face[i + 1]);
+    }
+  }
+  else if ((p[0] == 'o' || p[0] == 'g') && isSpace(p[1])) {
+    p++;
+    skipSpaces(p, end);
+
+    const char* nameEnd = end;
+    while (nameEnd > p && isSpace(nameEnd[-1])) {
+      nameEnd--;
+    }
+
+    ObjShape shape{};
+    shape.name.assign(p, nameEnd);
+    shape.firstIndex = static_cast<uint32_t>(chunk.indices.size());
+    chunk.shapes.push_back(std::move(shape));
+  }
+}
+
+void parseChunk(const char* begin, const char* end, ObjChunk& chunk) {
+  // rough guess from typical OBJ line lengths, saves most regrowth
+  size_t estimatedLines = static_cast<size_t>(end - begin) / 32;
+  chunk.positions.reserve(estimatedLines / 2);
+  chunk.colors.reserve(estimatedLines / 2);
+  chunk.indices.reserve(estimatedLines * 3 / 2);
+
+  std::vector<ObjIndex> face;
+  const char* p = begin;
+  while (p < end) {
+    const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (lineEnd == nullptr) {
+      lineEnd = end;
+    }
+
+    parseLine(p, lineEnd, chunk, face);
+    p = lineEnd + 1;
+  }
+}
+
+template<typename T>
+void copyInto(std::vector<T>& destination, size_t offset, const std::vector<T>& source) {
+  std::copy(source.begin(), source.end(), destination.begin() + offset);
+}
+
+} // namespace
+
+ObjMesh parseObjParallel(const char* data, size_t size, unsigned int threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / minChunkSize));
+
+  // split evenly, then push every boundary forward to the next line start
+  std::vector<const char*> boundaries(chunkCount + 1);
+  boundaries[0] = data;
+  boundaries[chunkCount] = data + size;
+  for (size_t i = 1; i < chunkCount; i++) {
+    const char* split = std::max(data + size * i / chunkCount, boundaries[i - 1]);
+    const char* lineEnd = static_cast<const char*>(memchr(split, '\n', data + size - split));
+    boundaries[i] = lineEnd != nullptr ? lineEnd + 1 : data + size;
+  }
+
+  std::vector<ObjChunk> chunks(chunkCount);
+  std::vector<std::future<void>> parsing;
+  for (size_t i = 0; i < chunkCount; i++) {
+    parsing.push_back(std::async(std::launch::async, [&, i]() {
+      parseChunk(boundaries[i], boundaries[i + 1], chunks[i]);
+    }));
+  }
+  for (auto& task : parsing) {
+    task.get();
+  }
+
+  struct ChunkBase {
+    size_t positions = 0;
+    size_t texCoords = 0;
+    size_t normals = 0;
+    size_t indices = 0;
+  };
+
+  std::vector<ChunkBase> bases(chunkCount + 1);
+  bool hasColors = false;
+  for (size_t i = 0; i < chunkCount; i++) {
+    bases[i + 1].positions = bases[i].positions + chunks[i].positions.size();
+    bases[i + 1].texCoords = bases[i].texCoords + chunks[i].texCoords.size();
+    bases[i + 1].normals = bases[i].normals + chunks[i].normals.size();
+    bases[i + 1].indices = bases[i].indices + chunks[i].indices.size();
+    hasColors = hasColors || chunks[i].hasColors;
+  }
+  const ChunkBase& totals = bases[chunkCount];
+
+  if (totals.indices > UINT32_MAX) {
+    throw std::runtime_error("obj file has too many faces!");
+  }
+
+  ObjMesh mesh;
+  mesh.positions.resize(totals.positions);
+  mesh.colors.resize(hasColors ? totals.positions : 0);
+  mesh.texCoords.resize(totals.texCoords);
+  mesh.normals.resize(totals.normals);
+  mesh.indices.resize(totals.indices);
+
+  std::vector<std::future<void>> merging;
+  for (size_t i = 0; i < chunkCount; i++) {
+    merging.push_back(std::async(std::launch::async, [&, i]() {
+      const ObjChunk& chunk = chunks[i];
+      const ChunkBase& base = bases[i];
+
+      copyInto(mesh.positions, base.positions, chunk.positions);
+      if (hasColors) {
+        copyInto(mesh.colors, base.positions, chunk.colors);
+      }
+      copyInto(mesh.texCoords, base.texCoords, chunk.texCoords);
+      copyInto(mesh.normals, base.normals, chunk.normals);
+
+      ObjIndex* destination = mesh.indices.data() + base.indices;
+      for (const ObjIndex& encoded : chunk.indices) {
+        ObjIndex& index = *destination++;
+        index.position = resolveIndex(encoded.position, base.positions, totals.positions);
+        index.texCoord = resolveIndex(encoded.texCoord, base.texCoords, totals.texCoords);
+        index.normal = resolveIndex(encoded.normal, base.normals, totals.normals);
+      }
+    }));
+  }
+  for (auto& task : merging) {
+    task.get();
+  }
+
+  // faces before the first `o`/`g` belong to an unnamed shape
+  for (size_t i = 0; i < chunkCount; i++) {
+    for (const ObjShape& shape : chunks[i].shapes) {
+      mesh.shapes.push_back(shape);
+      mesh.shapes.back().firstIndex += static_cast<uint32_t>(bases[i].indices);
+    }
+  }
+  if (mesh.shapes.empty() || mesh.shapes.front().firstIndex != 0) {
+    mesh.shapes.insert(mesh.shapes.begin(), ObjShape{ "", 0, 0 });
+  }
+
+  for (size_t i = 0; i < mesh.shapes.size(); i++) {
+    uint32_t nextFirst = i + 1 < mesh.shapes.size()
+      ? mesh.shapes[i + 1].firstIndex
+      : static_cast<uint32_t>(totals.indices);
+    mesh.shapes[i].indexCount = nextFirst - mesh.shapes[i].firstIndex;
+  }
+  mesh.shapes.erase(
+    std::remove_if(mesh.shapes.begin(), mesh.shapes.end(), [](const ObjShape& shape) {
+      return shape.indexCount == 0;
+    }),
+    mesh.shapes.end());
+
+  return mesh;
+}
+
+ObjMesh loadObjParallel(const std::string& filename, unsigned int threadCount) {
+  MappedFile file(filename);
+  return parseObjParallel(file.data(), file.size(), threadCount);
+}
+
+Vertex makeObjVertex(const ObjMesh& mesh, const ObjIndex& index) {
+  Vertex vertex{};
+  vertex.pos = mesh.positions[index.position];
+  vertex.color = mesh.colors.empty() ? glm::vec3(1.0f, 1.0f, 1.0f) : mesh.colors[index.position];
+
+  if (index.texCoord >= 0) {
+    const glm::vec2& texCoord = mesh.texCoords[index.texCoord];
+    vertex.texCoord = glm::vec2(texCoord.x, 1.0f - texCoord.y);
+  }
+
+  return vertex;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One triangle corner. Every member indexes the matching attribute array of
+// ObjMesh, or is -1 when the face did not reference that attribute.
+struct ObjIndex {
+  int32_t position;
+  int32_t texCoord;
+  int32_t normal;
+};
+
+// A run of triangles started by an `o` or `g` statement.
+struct ObjShape {
+  std::string name;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+};
+
+struct ObjMesh {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> colors; // empty unless the file has per-vertex colors
+  std::vector<glm::vec2> texCoords;
+  std::vector<glm::vec3> normals;
+
+  // three corners per triangle, polygons are fan-triangulated
+  std::vector<ObjIndex> indices;
+  std::vector<ObjShape> shapes;
+};
+
+// Parses Wavefront OBJ geometry (v, vt, vn, f, o, g) by splitting the input on
+// line boundaries and handing each chunk to its own thread. threadCount = 0
+// uses every hardware thread. Materials and other statements are ignored.
+ObjMesh parseObjParallel(const char* data, size_t size, unsigned int threadCount = 0);
+
+// Memory-maps filename and parses it with parseObjParallel.
+ObjMesh loadObjParallel(const std::string& filename, unsigned int threadCount = 0);
+
+// Builds the renderer's vertex for one triangle corner. Texture coordinates
+// are flipped vertically since OBJ puts the origin at the bottom left.
+Vertex makeObjVertex(const ObjMesh& mesh, const ObjIndex& index);
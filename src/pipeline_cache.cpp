@@ -0,0 +1,90 @@
+#include "pipeline_cache.h"
+
+#include "mapped_file.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+const char pipelineCacheMagic[4] = { 'V', 'K', 'P', 'C' };
+
+PipelineCacheFileHeader makeHeader(const VkPhysicalDeviceProperties& properties, uint64_t dataSize) {
+  PipelineCacheFileHeader header{};
+  memcpy(header.magic, pipelineCacheMagic, sizeof(pipelineCacheMagic));
+  header.version = pipelineCacheFileVersion;
+  header.vendorID = properties.vendorID;
+  header.deviceID = properties.deviceID;
+  header.driverVersion = properties.driverVersion;
+  memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+  header.dataSize = dataSize;
+  return header;
+}
+
+} // namespace
+
+std::vector<char> readPipelineCache(const std::string& path, const VkPhysicalDeviceProperties& properties) {
+  if (!std::filesystem::exists(path)) {
+    return {};
+  }
+
+  MappedFile file(path);
+  PipelineCacheFileHeader header;
+  if (file.size() < sizeof(header)) {
+    return {};
+  }
+  memcpy(&header, file.data(), sizeof(header));
+
+  PipelineCacheFileHeader expected = makeHeader(properties, header.dataSize);
+  if (memcmp(&header, &expected, sizeof(header)) != 0 || header.dataSize != file.size() - sizeof(header)) {
+    return {};
+  }
+
+  // the blob repeats vendor, device and UUID in its own header version one
+  VkPipelineCacheHeaderVersionOne blobHeader;
+  if (header.dataSize < sizeof(blobHeader)) {
+    return {};
+  }
+  memcpy(&blobHeader, file.data() + sizeof(header), sizeof(blobHeader));
+  if (blobHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+    || blobHeader.vendorID != properties.vendorID
+    || blobHeader.deviceID != properties.deviceID
+    || memcmp(blobHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+  {
+    return {};
+  }
+
+  return std::vector<char>(file.data() + sizeof(header), file.data() + file.size());
+}
+
+void writePipelineCache(
+  const std::string& path,
+  const VkPhysicalDeviceProperties& properties,
+  const std::vector<char>& data)
+{
+  PipelineCacheFileHeader header = makeHeader(properties, data.size());
+
+  std::filesystem::path directory = std::filesystem::path(path).parent_path();
+  if (!directory.empty()) {
+    std::filesystem::create_directories(directory);
+  }
+
+  std::string temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to create pipeline cache!");
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+    if (!file) {
+      throw std::runtime_error("failed to write pipeline cache!");
+    }
+  }
+
+  std::filesystem::rename(temporaryPath, path);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk VkPipelineCache data. The driver's blob is stored behind a small
+// header naming the device and driver it came from:
+//
+//   PipelineCacheFileHeader
+//   dataSize bytes from vkGetPipelineCacheData
+//
+// Drivers must reject foreign data themselves, but some crash instead, and
+// the Vulkan header of the blob does not cover the driver version, so the
+// file is checked against both before any of it reaches the driver.
+const uint32_t pipelineCacheFileVersion = 1;
+
+struct PipelineCacheFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  uint32_t reserved; // zero, keeps the header free of padding
+  uint64_t dataSize;
+};
+
+static_assert(sizeof(PipelineCacheFileHeader) == 48, "pipeline cache header must not have padding");
+
+// Initial data for vkCreatePipelineCache: the cached blob if path holds one
+// made by this device and driver, otherwise empty.
+std::vector<char> readPipelineCache(const std::string& path, const VkPhysicalDeviceProperties& properties);
+
+// Stores data from vkGetPipelineCacheData. The file is written under a
+// temporary name and renamed into place, so a crash never leaves half a
+// cache behind.
+void writePipelineCache(
+  const std::string& path,
+  const VkPhysicalDeviceProperties& properties,
+  const std::vector<char>& data);
@@ -0,0 +1,168 @@
+#include "pipeline_compiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+PipelineCompiler::PipelineCompiler(VkDevice device, VkPipelineCache pipelineCache, unsigned int threadCount)
+  : device(device), pipelineCache(pipelineCache)
+{
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+  }
+
+  for (unsigned int i = 0; i < threadCount; i++) {
+    workers.emplace_back(&PipelineCompiler::work, this);
+  }
+}
+
+PipelineCompiler::~PipelineCompiler() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+    queue.clear();
+  }
+  queueChanged.notify_all();
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+std::future<CompiledPipeline> PipelineCompiler::compile(GraphicsPipelineDescription description) {
+  std::packaged_task<CompiledPipeline()> task([this, description = std::move(description)]() {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    VkPipeline pipeline = createPipeline(description);
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    float seconds = std::chrono::duration<float, std::chrono::seconds::period>(endTime - startTime).count();
+    std::lock_guard<std::mutex> lock(queueMutex);
+    statistics.totalCompileSeconds += seconds;
+    statistics.maxCompileSeconds = std::max(statistics.maxCompileSeconds, seconds);
+    statistics.lastCompileSeconds = seconds;
+    return CompiledPipeline{ pipeline, seconds };
+  });
+  std::future<CompiledPipeline> result = task.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queue.push_back(std::move(task));
+    statistics.queued = queue.size();
+  }
+  queueChanged.notify_one();
+
+  return result;
+}
+
+PipelineCompilerStats PipelineCompiler::stats() const {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return statistics;
+}
+
+void PipelineCompiler::work() {
+  for (;;) {
+    std::packaged_task<CompiledPipeline()> task;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueChanged.wait(lock, [this]() { return stopping || !queue.empty(); });
+      if (stopping) {
+        return;
+      }
+      task = std::move(queue.front());
+      queue.pop_front();
+      statistics.queued = queue.size();
+      statistics.compiling++;
+    }
+
+    // a failure is stored in the future, the counters are kept right either way
+    task();
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    statistics.compiling--;
+    statistics.completed++;
+  }
+}
+
+VkPipeline PipelineCompiler::createPipeline(const GraphicsPipelineDescription& description) const {
+  std::vector<VkShaderModule> modules;
+  std::vector<VkPipelineShaderStageCreateInfo> stages;
+
+  auto destroyModules = [&]() {
+    for (VkShaderModule module : modules) {
+      vkDestroyShaderModule(device, module, nullptr);
+    }
+  };
+
+  for (const ShaderStageDescription& stage : description.stages) {
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = stage.code.size();
+    moduleInfo.pCode = stage.code.data();
+
+    VkShaderModule module;
+    if (vkCreateShaderModule(device, &moduleInfo, nullptr, &module) != VK_SUCCESS) {
+      destroyModules();
+      throw std::runtime_error("failed to create shader module!");
+    }
+    modules.push_back(module);
+
+    VkPipelineShaderStageCreateInfo stageInfo{};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = stage.stage;
+    stageInfo.module = module;
+    stageInfo.pName = "main";
+    stages.push_back(stageInfo);
+  }
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(description.vertexBindings.size());
+  vertexInputInfo.pVertexBindingDescriptions = description.vertexBindings.data();
+  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertexAttributes.size());
+  vertexInputInfo.pVertexAttributeDescriptions = description.vertexAttributes.data();
+
+  VkPipelineViewportStateCreateInfo viewportState{};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  VkPipelineColorBlendStateCreateInfo colorBlending = description.colorBlending;
+  colorBlending.attachmentCount = static_cast<uint32_t>(description.colorBlendAttachments.size());
+  colorBlending.pAttachments = description.colorBlendAttachments.data();
+
+  std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+  dynamicStates.insert(dynamicStates.end(), description.dynamicStates.begin(), description.dynamicStates.end());
+
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+  dynamicState.pDynamicStates = dynamicStates.data();
+
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+  pipelineInfo.pStages = stages.data();
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &description.inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pRasterizationState = &description.rasterizer;
+  pipelineInfo.pMultisampleState = &description.multisampling;
+  pipelineInfo.pDepthStencilState = &description.depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.layout = description.layout;
+  pipelineInfo.renderPass = description.renderPass;
+  pipelineInfo.subpass = description.subpass;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+  pipelineInfo.basePipelineIndex = -1;
+
+  VkPipeline pipeline;
+  VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+  destroyModules();
+
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to create graphics pipeline " + description.name + "!");
+  }
+
+  return pipeline;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "shader_library.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ShaderStageDescription {
+  VkShaderStageFlagBits stage;
+  ShaderCode code;
+};
+
+// Everything vkCreateGraphicsPipelines needs, held by value so the pipeline
+// can be compiled after the caller has moved on. The pointer members of the
+// state structs (pAttachments, pDynamicStates, ...) are ignored and filled
+// in from the vectors here; viewport and scissor are always dynamic.
+struct GraphicsPipelineDescription {
+  std::string name; // for logs and metrics
+  std::vector<ShaderStageDescription> stages;
+  std::vector<VkVertexInputBindingDescription> vertexBindings;
+  std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+  VkPipelineRasterizationStateCreateInfo rasterizer;
+  VkPipelineMultisampleStateCreateInfo multisampling;
+  VkPipelineDepthStencilStateCreateInfo depthStencil;
+  std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments;
+  VkPipelineColorBlendStateCreateInfo colorBlending;
+  std::vector<VkDynamicState> dynamicStates; // in addition to viewport and scissor
+  VkPipelineLayout layout;
+  VkRenderPass renderPass;
+  uint32_t subpass;
+};
+
+struct CompiledPipeline {
+  VkPipeline pipeline; // owned by the caller
+  float compileSeconds;
+};
+
+struct PipelineCompilerStats {
+  size_t queued;    // submitted, not started
+  size_t compiling; // on a worker right now
+  size_t completed;
+  float totalCompileSeconds;
+  float maxCompileSeconds;
+  float lastCompileSeconds;
+};
+
+// Compiles graphics pipelines on worker threads, so the render thread never
+// blocks on the driver's shader compiler. All workers share one
+// VkPipelineCache, which Vulkan synchronizes internally. The future holds
+// the pipeline, or rethrows the failure.
+class PipelineCompiler {
+public:
+  // 0 uses half the hardware threads; device and pipelineCache must outlive
+  // the compiler
+  PipelineCompiler(VkDevice device, VkPipelineCache pipelineCache, unsigned int threadCount = 0);
+  // waits for the pipeline being compiled; queued ones are dropped and their
+  // futures report std::future_error
+  ~PipelineCompiler();
+
+  PipelineCompiler(const PipelineCompiler&) = delete;
+  PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+  std::future<CompiledPipeline> compile(GraphicsPipelineDescription description);
+
+  PipelineCompilerStats stats() const;
+
+private:
+  void work();
+  VkPipeline createPipeline(const GraphicsPipelineDescription& description) const;
+
+  VkDevice device;
+  VkPipelineCache pipelineCache;
+
+  std::vector<std::thread> workers;
+  std::deque<std::packaged_task<CompiledPipeline()>> queue;
+  mutable std::mutex queueMutex;
+  std::condition_variable queueChanged;
+  bool stopping = false;
+  PipelineCompilerStats statistics{};
+};
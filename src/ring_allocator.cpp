@@ -0,0 +1,80 @@
+#include "ring_allocator.h"
+
+#include <algorithm>
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+RingAllocator::RingAllocator(uint64_t capacity) : ringSize(capacity) {}
+
+std::optional<RingAllocation> RingAllocator::allocate(uint64_t size, uint64_t alignment) {
+  uint64_t offset = 0;
+  bool fits;
+
+  if (ranges.empty()) {
+    fits = size <= ringSize;
+  } else {
+    uint64_t head = ranges.back().end;
+    uint64_t tail = ranges.front().begin;
+    offset = alignUp(head, alignment);
+
+    if (head > tail) {
+      // the free space is after head and before tail, at the start
+      fits = offset <= ringSize && size <= ringSize - offset;
+      if (!fits) {
+        offset = 0;
+        fits = size <= tail;
+      }
+    } else {
+      // wrapped around, the free space is between head and tail
+      fits = offset <= tail && size <= tail - offset;
+    }
+  }
+
+  // an empty range would be indistinguishable from a full ring
+  if (!fits || size == 0) {
+    statistics.failedAllocationCount++;
+    return std::nullopt;
+  }
+
+  RingAllocation allocation{ nextId++, offset };
+  ranges.push_back(Range{ allocation.id, offset, offset + size, false });
+
+  statistics.allocationCount++;
+  statistics.peakBytesInUse = std::max(statistics.peakBytesInUse, bytesInUse());
+  return allocation;
+}
+
+void RingAllocator::release(uint64_t id) {
+  for (Range& range : ranges) {
+    if (range.id == id) {
+      range.released = true;
+      break;
+    }
+  }
+
+  while (!ranges.empty() && ranges.front().released) {
+    ranges.pop_front();
+  }
+}
+
+RingAllocatorStats RingAllocator::stats() const {
+  RingAllocatorStats result = statistics;
+  result.bytesInUse = bytesInUse();
+  return result;
+}
+
+uint64_t RingAllocator::bytesInUse() const {
+  if (ranges.empty()) {
+    return 0;
+  }
+
+  uint64_t head = ranges.back().end;
+  uint64_t tail = ranges.front().begin;
+  return head > tail ? head - tail : ringSize - tail + head;
+}
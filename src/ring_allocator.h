@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+struct RingAllocation {
+  uint64_t id; // for release
+  uint64_t offset;
+};
+
+struct RingAllocatorStats {
+  uint64_t bytesInUse; // including alignment and wrap-around padding
+  uint64_t peakBytesInUse;
+  uint64_t allocationCount;
+  uint64_t failedAllocationCount;
+};
+
+// Hands out ranges of a fixed-size ring front to back, for memory that is
+// written once and then read by the GPU until a submit completes. Ranges
+// can be released in any order, but their space only comes back once every
+// older range is released too, which matches submits completing in order.
+class RingAllocator {
+public:
+  explicit RingAllocator(uint64_t capacity);
+
+  // nullopt when size bytes do not fit until older ranges are released
+  std::optional<RingAllocation> allocate(uint64_t size, uint64_t alignment);
+  void release(uint64_t id);
+
+  uint64_t capacity() const { return ringSize; }
+  RingAllocatorStats stats() const;
+
+private:
+  struct Range {
+    uint64_t id;
+    uint64_t begin;
+    uint64_t end;
+    bool released;
+  };
+
+  uint64_t bytesInUse() const;
+
+  uint64_t ringSize;
+  std::deque<Range> ranges; // oldest first
+  uint64_t nextId = 1;
+  RingAllocatorStats statistics{};
+};
@@ -0,0 +1,48 @@
+#include "shader_library.h"
+
+#include "embedded_shaders.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+ShaderCode readShaderFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open shader file!");
+  }
+
+  size_t fileSize = static_cast<size_t>(file.tellg());
+  if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0) {
+    throw std::runtime_error("shader file is not SPIR-V!");
+  }
+
+  // read into words so the code is aligned the way Vulkan requires
+  std::vector<uint32_t> words(fileSize / sizeof(uint32_t));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(words.data()), static_cast<std::streamsize>(fileSize));
+  return ShaderCode(std::move(words));
+}
+
+} // namespace
+
+ShaderCode loadShader(const std::string& name) {
+  const char* directory = std::getenv(shaderDirectoryVariable);
+  if (directory != nullptr && directory[0] != '\0') {
+    std::filesystem::path path = std::filesystem::path(directory) / (name + ".spv");
+    if (std::filesystem::exists(path)) {
+      return readShaderFile(path);
+    }
+  }
+
+  for (const EmbeddedShader* shader = embeddedShaders; shader->name != nullptr; shader++) {
+    if (name == shader->name) {
+      return ShaderCode(shader->code, shader->size);
+    }
+  }
+
+  throw std::runtime_error("failed to find shader!");
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// SPIR-V of one shader, either pointing into the executable or owning words
+// read from disk.
+class ShaderCode {
+public:
+  ShaderCode(const uint32_t* code, size_t size) : embedded(code), embeddedSize(size) {}
+  explicit ShaderCode(std::vector<uint32_t>&& words) : storage(std::move(words)) {}
+
+  const uint32_t* data() const { return embedded != nullptr ? embedded : storage.data(); }
+  size_t size() const { return embedded != nullptr ? embeddedSize : storage.size() * sizeof(uint32_t); }
+
+private:
+  const uint32_t* embedded = nullptr;
+  size_t embeddedSize = 0;
+  std::vector<uint32_t> storage;
+};
+
+// Environment variable naming a directory of compiled <name>.spv files that
+// replace the embedded shaders, for iterating on shaders without a rebuild.
+// Shaders missing from the directory still come from the executable.
+const char* const shaderDirectoryVariable = "VULKAN_PLAYGROUND_SHADER_DIR";
+
+// Shader by source file name, e.g. "shader.vert". Comes from the shader
+// directory override when it is set, and from the SPIR-V embedded by the
+// build otherwise.
+ShaderCode loadShader(const std::string& name);
@@ -0,0 +1,445 @@
+#include "texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace {
+
+const unsigned char ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct Ktx2Header {
+  unsigned char identifier[12];
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount; // 0 asks the loader to generate the chain
+  uint32_t supercompressionScheme;
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+
+struct Ktx2Level {
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must match the file layout");
+static_assert(sizeof(Ktx2Level) == 24, "KTX2 level index entry must match the file layout");
+
+constexpr uint32_t fourCC(char a, char b, char c, char d) {
+  return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8
+    | static_cast<uint32_t>(c) << 16 | static_cast<uint32_t>(d) << 24;
+}
+
+const uint32_t ddsMagic = fourCC('D', 'D', 'S', ' ');
+const uint32_t ddsMipMapCountFlag = 0x20000;
+const uint32_t ddsDepthFlag = 0x800000;
+const uint32_t ddsFourCCFlag = 0x4;
+const uint32_t ddsCubemapCaps = 0x200;
+const uint32_t ddsTexture2D = 3;
+const uint32_t ddsTextureCubeMisc = 0x4;
+
+struct DdsPixelFormat {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t fourCC;
+  uint32_t rgbBitCount;
+  uint32_t bitMasks[4];
+};
+
+struct DdsHeader {
+  uint32_t magic;
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t pitchOrLinearSize;
+  uint32_t depth;
+  uint32_t mipMapCount;
+  uint32_t reserved1[11];
+  DdsPixelFormat pixelFormat;
+  uint32_t caps;
+  uint32_t caps2;
+  uint32_t caps3;
+  uint32_t caps4;
+  uint32_t reserved2;
+};
+
+struct DdsHeaderDx10 {
+  uint32_t dxgiFormat;
+  uint32_t resourceDimension;
+  uint32_t miscFlag;
+  uint32_t arraySize;
+  uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DdsHeader) == 128, "DDS header must match the file layout");
+static_assert(sizeof(DdsHeaderDx10) == 20, "DDS DX10 header must match the file layout");
+
+// DXGI_FORMAT values of the formats textureLevelSize knows about.
+VkFormat formatFromDxgi(uint32_t dxgiFormat) {
+  switch (dxgiFormat) {
+    case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+    case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+    case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+    case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+    case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+    case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+    case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+    default: return VK_FORMAT_UNDEFINED;
+  }
+}
+
+// Legacy DDS files do not say whether they hold color; the color formats are
+// read as sRGB like decoded images are, BC5 (normal maps) stays linear.
+VkFormat formatFromFourCC(uint32_t code) {
+  switch (code) {
+    case fourCC('D', 'X', 'T', '1'): return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case fourCC('D', 'X', 'T', '5'): return VK_FORMAT_BC3_SRGB_BLOCK;
+    case fourCC('A', 'T', 'I', '2'):
+    case fourCC('B', 'C', '5', 'U'): return VK_FORMAT_BC5_UNORM_BLOCK;
+    default: return VK_FORMAT_UNDEFINED;
+  }
+}
+
+void checkTextureSize(VkFormat format, uint32_t width, uint32_t height, uint32_t levelCount) {
+  if (textureLevelSize(format, 1, 1) == 0) {
+    throw std::runtime_error("unsupported texture format!");
+  }
+  if (width == 0 || height == 0 || levelCount == 0 || levelCount > mipLevelCount(width, height)) {
+    throw std::runtime_error("malformed texture dimensions!");
+  }
+}
+
+// Adds mip level `level` of texture, stored at sourceOffset in its file.
+void appendLevel(TextureData& texture, uint32_t level, uint64_t sourceOffset, uint64_t available) {
+  TextureLevel textureLevel{};
+  textureLevel.width = std::max(texture.levels[0].width >> level, 1u);
+  textureLevel.height = std::max(texture.levels[0].height >> level, 1u);
+  textureLevel.offset = level == 0 ? 0 : texture.levels.back().offset + texture.levels.back().size;
+  textureLevel.size = textureLevelSize(texture.format, textureLevel.width, textureLevel.height);
+  textureLevel.sourceOffset = static_cast<size_t>(sourceOffset);
+
+  if (textureLevel.size > available) {
+    throw std::runtime_error("texture file is truncated!");
+  }
+
+  if (level == 0) {
+    texture.levels[0] = textureLevel;
+  } else {
+    texture.levels.push_back(textureLevel);
+  }
+}
+
+TextureData loadKtx2(MappedFile&& file) {
+  Ktx2Header header;
+  if (file.size() < sizeof(header)) {
+    throw std::runtime_error("texture file is truncated!");
+  }
+  memcpy(&header, file.data(), sizeof(header));
+
+  if (memcmp(header.identifier, ktx2Identifier, sizeof(ktx2Identifier)) != 0) {
+    throw std::runtime_error("not a KTX2 file!");
+  }
+  if (header.pixelDepth != 0 || header.layerCount > 1 || header.faceCount != 1) {
+    throw std::runtime_error("unsupported KTX2 texture, expected a single 2D image!");
+  }
+  if (header.supercompressionScheme != 0) {
+    throw std::runtime_error("unsupported KTX2 supercompression!");
+  }
+
+  TextureData texture;
+  texture.format = static_cast<VkFormat>(header.vkFormat);
+  uint32_t levelCount = std::max(header.levelCount, 1u);
+  checkTextureSize(texture.format, header.pixelWidth, header.pixelHeight, levelCount);
+
+  if ((file.size() - sizeof(header)) / sizeof(Ktx2Level) < levelCount) {
+    throw std::runtime_error("texture file is truncated!");
+  }
+
+  texture.levels.push_back(TextureLevel{ header.pixelWidth, header.pixelHeight, 0, 0, 0 });
+  for (uint32_t level = 0; level < levelCount; level++) {
+    Ktx2Level index;
+    memcpy(&index, file.data() + sizeof(header) + level * sizeof(Ktx2Level), sizeof(index));
+    if (index.byteOffset > file.size() || index.byteLength > file.size() - index.byteOffset) {
+      throw std::runtime_error("texture file is truncated!");
+    }
+    appendLevel(texture, level, index.byteOffset, index.byteLength);
+  }
+
+  texture.file = std::move(file);
+  return texture;
+}
+
+TextureData loadDds(MappedFile&& file) {
+  DdsHeader header;
+  if (file.size() < sizeof(header)) {
+    throw std::runtime_error("texture file is truncated!");
+  }
+  memcpy(&header, file.data(), sizeof(header));
+
+  if (header.magic != ddsMagic || header.size != sizeof(header) - sizeof(header.magic)) {
+    throw std::runtime_error("not a DDS file!");
+  }
+  if ((header.flags & ddsDepthFlag) != 0 || (header.caps2 & ddsCubemapCaps) != 0) {
+    throw std::runtime_error("unsupported DDS texture, expected a single 2D image!");
+  }
+  if ((header.pixelFormat.flags & ddsFourCCFlag) == 0) {
+    throw std::runtime_error("unsupported DDS format!");
+  }
+
+  TextureData texture;
+  size_t dataOffset = sizeof(header);
+
+  if (header.pixelFormat.fourCC == fourCC('D', 'X', '1', '0')) {
+    DdsHeaderDx10 dx10;
+    if (file.size() < sizeof(header) + sizeof(dx10)) {
+      throw std::runtime_error("texture file is truncated!");
+    }
+    memcpy(&dx10, file.data() + sizeof(header), sizeof(dx10));
+    dataOffset += sizeof(dx10);
+
+    if (dx10.resourceDimension != ddsTexture2D || dx10.arraySize > 1 || (dx10.miscFlag & ddsTextureCubeMisc) != 0) {
+      throw std::runtime_error("unsupported DDS texture, expected a single 2D image!");
+    }
+    texture.format = formatFromDxgi(dx10.dxgiFormat);
+  } else {
+    texture.format = formatFromFourCC(header.pixelFormat.fourCC);
+  }
+
+  uint32_t levelCount = (header.flags & ddsMipMapCountFlag) != 0 ? std::max(header.mipMapCount, 1u) : 1;
+  checkTextureSize(texture.format, header.width, header.height, levelCount);
+
+  // levels follow the headers back to back, largest first
+  texture.levels.push_back(TextureLevel{ header.width, header.height, 0, 0, 0 });
+  for (uint32_t level = 0; level < levelCount; level++) {
+    appendLevel(texture, level, dataOffset, file.size() - dataOffset);
+    dataOffset += texture.levels[level].size;
+  }
+
+  texture.file = std::move(file);
+  return texture;
+}
+
+// Decodes straight from the mapping; stbi_load would read the file through
+// stdio buffers first.
+TextureData loadDecodedTexture(const MappedFile& file) {
+  if (file.size() > static_cast<size_t>(INT_MAX)) {
+    throw std::runtime_error("failed to load texture image!");
+  }
+
+  int texWidth, texHeight, texChannels;
+  stbi_uc* pixels = stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc*>(file.data()),
+    static_cast<int>(file.size()),
+    &texWidth,
+    &texHeight,
+    &texChannels,
+    STBI_rgb_alpha);
+
+  if (!pixels) {
+    throw std::runtime_error("failed to load texture image!");
+  }
+
+  TextureData texture;
+  texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+
+  TextureLevel level{};
+  level.width = static_cast<uint32_t>(texWidth);
+  level.height = static_cast<uint32_t>(texHeight);
+  level.offset = 0;
+  level.size = static_cast<size_t>(texWidth) * texHeight * 4;
+  level.sourceOffset = 0;
+  texture.levels.push_back(level);
+
+  texture.decoded = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
+
+  return texture;
+}
+
+std::string lowercaseExtension(const std::string& filename) {
+  std::string extension = std::filesystem::path(filename).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return extension;
+}
+
+float srgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float value) {
+  return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+} // namespace
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  for (uint32_t size = std::max(width, height); size > 1; size /= 2) {
+    levels++;
+  }
+  return levels;
+}
+
+bool isBlockCompressed(VkFormat format) {
+  // a 1x1 level of a block format still takes a whole 8 or 16 byte block
+  return textureLevelSize(format, 1, 1) >= 8;
+}
+
+size_t textureLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+  size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+  switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      return static_cast<size_t>(width) * height * 4;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+      return blocks * 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return blocks * 16;
+    default:
+      return 0;
+  }
+}
+
+TextureData loadTexture(const std::string& filename) {
+  MappedFile file(filename);
+  file.adviseSequential();
+  return loadTexture(filename, std::move(file));
+}
+
+TextureData loadTexture(const std::string& filename, MappedFile&& file) {
+  std::string extension = lowercaseExtension(filename);
+
+  if (extension == ".ktx2") {
+    return loadKtx2(std::move(file));
+  }
+  if (extension == ".dds") {
+    return loadDds(std::move(file));
+  }
+  return loadDecodedTexture(file);
+}
+
+bool isCompressedTextureFile(const std::string& filename) {
+  std::string extension = lowercaseExtension(filename);
+  return extension == ".ktx2" || extension == ".dds";
+}
+
+void generateMipChain(TextureData& texture) {
+  bool srgb = texture.format == VK_FORMAT_R8G8B8A8_SRGB;
+  if (texture.levels.size() != 1 || (!srgb && texture.format != VK_FORMAT_R8G8B8A8_UNORM)) {
+    throw std::runtime_error("mip chains can only be generated for single-level RGBA8 textures!");
+  }
+
+  float toFloat[256];
+  for (int i = 0; i < 256; i++) {
+    toFloat[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+  }
+
+  const TextureLevel topLevel = texture.levels[0];
+  uint32_t levelCount = mipLevelCount(topLevel.width, topLevel.height);
+
+  std::vector<TextureLevel> levels{ TextureLevel{ topLevel.width, topLevel.height, 0, topLevel.size, 0 } };
+  for (uint32_t level = 1; level < levelCount; level++) {
+    TextureLevel next{};
+    next.width = std::max(topLevel.width >> level, 1u);
+    next.height = std::max(topLevel.height >> level, 1u);
+    next.offset = levels.back().offset + levels.back().size;
+    next.size = textureLevelSize(texture.format, next.width, next.height);
+    next.sourceOffset = next.offset;
+    levels.push_back(next);
+  }
+
+  std::vector<unsigned char> pixels(levels.back().offset + levels.back().size);
+  memcpy(pixels.data(), texture.levelData(0), topLevel.size);
+
+  // each level is filtered from the linear values of the one above it, so
+  // rounding to 8 bits does not accumulate down the chain
+  std::vector<float> previous(topLevel.size);
+  for (size_t i = 0; i < topLevel.size; i++) {
+    previous[i] = (i % 4 == 3) ? pixels[i] / 255.0f : toFloat[pixels[i]];
+  }
+
+  for (uint32_t level = 1; level < levelCount; level++) {
+    const TextureLevel& source = levels[level - 1];
+    const TextureLevel& target = levels[level];
+    std::vector<float> current(static_cast<size_t>(target.width) * target.height * 4);
+
+    for (uint32_t y = 0; y < target.height; y++) {
+      uint32_t y0 = std::min(y * 2, source.height - 1);
+      uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+      for (uint32_t x = 0; x < target.width; x++) {
+        uint32_t x0 = std::min(x * 2, source.width - 1);
+        uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+
+        for (uint32_t c = 0; c < 4; c++) {
+          float sum = previous[(static_cast<size_t>(y0) * source.width + x0) * 4 + c]
+            + previous[(static_cast<size_t>(y0) * source.width + x1) * 4 + c]
+            + previous[(static_cast<size_t>(y1) * source.width + x0) * 4 + c]
+            + previous[(static_cast<size_t>(y1) * source.width + x1) * 4 + c];
+          float value = sum * 0.25f;
+          size_t index = (static_cast<size_t>(y) * target.width + x) * 4 + c;
+          current[index] = value;
+
+          float encoded = (srgb && c != 3) ? linearToSrgb(value) : value;
+          pixels[target.offset + index] =
+            static_cast<unsigned char>(std::clamp(encoded * 255.0f + 0.5f, 0.0f, 255.0f));
+        }
+      }
+    }
+
+    previous = std::move(current);
+  }
+
+  texture.levels = std::move(levels);
+  texture.pixels = std::move(pixels);
+  texture.decoded.reset();
+  texture.file = MappedFile();
+}
+
+const unsigned char* TextureData::levelData(size_t level) const {
+  const unsigned char* source = file.isOpen()
+    ? reinterpret_cast<const unsigned char*>(file.data())
+    : decoded ? decoded.get() : pixels.data();
+  return source + levels[level].sourceOffset;
+}
+
+size_t TextureData::uploadSize() const {
+  return levels.empty() ? 0 : levels.back().offset + levels.back().size;
+}
+
+void copyTextureLevels(const TextureData& texture, void* destination) {
+  for (size_t level = 0; level < texture.levels.size(); level++) {
+    const TextureLevel& textureLevel = texture.levels[level];
+    memcpy(static_cast<char*>(destination) + textureLevel.offset, texture.levelData(level), textureLevel.size);
+  }
+}
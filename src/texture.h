@@ -0,0 +1,74 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Number of levels in a full mip chain down to 1x1.
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+// BC formats store 4x4 texel blocks; they cannot be rendered or blitted to,
+// so their mip chains have to come pre-baked.
+bool isBlockCompressed(VkFormat format);
+
+// Bytes of one width x height level of a format loadTexture can return.
+size_t textureLevelSize(VkFormat format, uint32_t width, uint32_t height);
+
+// One mip level of a texture, largest first.
+struct TextureLevel {
+  uint32_t width;
+  uint32_t height;
+  size_t offset; // in the upload, where levels are packed back to back
+  size_t size;
+  size_t sourceOffset; // in TextureData::pixels, or in its file
+};
+
+// A texture as it is uploaded. A texture with a single level gets the rest
+// of its mip chain generated on the GPU; one that comes with pre-baked
+// levels is uploaded as is.
+//
+// Decoded images keep the decoder's buffer in decoded, and generated mip
+// chains own their texels in pixels. Container formats leave them in the
+// mapped file. Either way they are copied exactly once, into the staging
+// buffer.
+struct TextureData {
+  VkFormat format;
+  std::vector<TextureLevel> levels;
+  std::vector<unsigned char> pixels;
+  std::shared_ptr<unsigned char> decoded; // freed with stbi_image_free
+  MappedFile file;
+
+  const unsigned char* levelData(size_t level) const;
+  // bytes of all levels packed back to back
+  size_t uploadSize() const;
+};
+
+// Writes every level of texture to destination, at TextureLevel::offset.
+void copyTextureLevels(const TextureData& texture, void* destination);
+
+// Loads a texture by file extension, reading the file through a sequential
+// mapping:
+//
+//   .ktx2  KTX 2.0 without supercompression
+//   .dds   DDS, with or without the DX10 header
+//
+// both holding a single 2D image in BC1, BC3, BC5, BC7 or RGBA8, with
+// whatever mip levels the file contains. Anything else is decoded with
+// stb_image into the top level of an RGBA8 sRGB texture.
+TextureData loadTexture(const std::string& filename);
+// The same from filename already mapped, e.g. by an I/O thread.
+TextureData loadTexture(const std::string& filename, MappedFile&& file);
+
+// Whether loadTexture reads filename as a container of ready-to-upload
+// levels rather than decoding it.
+bool isCompressedTextureFile(const std::string& filename);
+
+// Box filters the rest of the mip chain of a single-level RGBA8 texture on
+// the CPU, averaging sRGB textures in linear space like the GPU blit does.
+void generateMipChain(TextureData& texture);
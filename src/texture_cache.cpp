@@ -0,0 +1,234 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char textureCacheMagic[4] = { 'V', 'K', 'P', 'T' };
+const char textureCacheExtension[] = ".vktex";
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t mix(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdull;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ull;
+  value ^= value >> 33;
+  return value;
+}
+
+// Word at a time multiply-xor hash; far faster than the decode it saves,
+// and 64 bits make accidental collisions between cached images negligible.
+uint64_t hashBytes(const char* data, size_t size, uint64_t seed) {
+  const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+  uint64_t hash = seed ^ (size * multiplier);
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ mix(word)) * multiplier;
+  }
+
+  if (i < size) {
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, size - i);
+    hash = (hash ^ mix(tail)) * multiplier;
+  }
+
+  return mix(hash);
+}
+
+} // namespace
+
+TextureCache::TextureCache(std::string directory, uint64_t maxBytes, bool generateMips)
+  : directory(std::move(directory)), maxBytes(maxBytes), generateMips(generateMips)
+{
+}
+
+uint64_t TextureCache::key(const std::string& sourcePath) const {
+  MappedFile file(sourcePath);
+  file.adviseSequential();
+  return key(file);
+}
+
+uint64_t TextureCache::key(const MappedFile& source) const {
+  // the decode settings go into the seed, so changing them misses the cache
+  uint64_t seed = mix(textureCacheVersion) ^ mix((static_cast<uint64_t>(VK_FORMAT_R8G8B8A8_SRGB) << 1) | generateMips);
+  return hashBytes(source.data(), source.size(), seed);
+}
+
+std::string TextureCache::entryPath(uint64_t key) const {
+  std::ostringstream name;
+  name << std::hex;
+  name.width(16);
+  name.fill('0');
+  name << key;
+  return (std::filesystem::path(directory) / (name.str() + textureCacheExtension)).string();
+}
+
+std::optional<TextureData> TextureCache::open(uint64_t key) const {
+  std::string path = entryPath(key);
+  std::error_code error;
+  if (!std::filesystem::exists(path, error)) {
+    return std::nullopt;
+  }
+
+  MappedFile file(path);
+  TextureCacheHeader header;
+  if (file.size() < sizeof(header)) {
+    return std::nullopt;
+  }
+  memcpy(&header, file.data(), sizeof(header));
+
+  bool valid = memcmp(header.magic, textureCacheMagic, sizeof(textureCacheMagic)) == 0
+    && header.version == textureCacheVersion
+    && header.key == key
+    && header.levelCount > 0
+    && (file.size() - sizeof(header)) / sizeof(TextureCacheLevel) >= header.levelCount
+    && header.dataOffset <= file.size();
+  if (!valid) {
+    return std::nullopt;
+  }
+
+  TextureData texture;
+  texture.format = static_cast<VkFormat>(header.format);
+  for (uint32_t i = 0; i < header.levelCount; i++) {
+    TextureCacheLevel level;
+    memcpy(&level, file.data() + sizeof(header) + i * sizeof(TextureCacheLevel), sizeof(level));
+    if (level.offset > file.size() - header.dataOffset || level.size > file.size() - header.dataOffset - level.offset) {
+      return std::nullopt;
+    }
+    texture.levels.push_back(TextureLevel{
+      level.width,
+      level.height,
+      static_cast<size_t>(level.offset),
+      static_cast<size_t>(level.size),
+      static_cast<size_t>(header.dataOffset + level.offset) });
+  }
+
+  file.adviseSequential();
+  texture.file = std::move(file);
+
+  // the modification time doubles as the last use for eviction
+  std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+  return texture;
+}
+
+TextureData TextureCache::decode(const std::string& sourcePath) const {
+  MappedFile source(sourcePath);
+  source.adviseSequential();
+  return decode(sourcePath, std::move(source));
+}
+
+TextureData TextureCache::decode(const std::string& sourcePath, MappedFile&& source) const {
+  TextureData texture = loadTexture(sourcePath, std::move(source));
+  if (generateMips) {
+    generateMipChain(texture);
+  }
+  return texture;
+}
+
+void TextureCache::write(uint64_t key, const TextureData& texture) const {
+  TextureCacheHeader header{};
+  memcpy(header.magic, textureCacheMagic, sizeof(textureCacheMagic));
+  header.version = textureCacheVersion;
+  header.key = key;
+  header.format = static_cast<uint32_t>(texture.format);
+  header.levelCount = static_cast<uint32_t>(texture.levels.size());
+  header.dataOffset = alignUp(
+    sizeof(header) + texture.levels.size() * sizeof(TextureCacheLevel),
+    textureCacheAlignment);
+
+  std::filesystem::create_directories(directory);
+
+  // loader threads can write the same entry at once, each under its own name
+  std::string path = entryPath(key);
+  std::string temporaryPath = path + "."
+    + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to create texture cache entry!");
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const TextureLevel& textureLevel : texture.levels) {
+      TextureCacheLevel level{ textureLevel.width, textureLevel.height, textureLevel.offset, textureLevel.size };
+      file.write(reinterpret_cast<const char*>(&level), sizeof(level));
+    }
+
+    static const char zeros[textureCacheAlignment] = {};
+    file.write(zeros, static_cast<std::streamsize>(header.dataOffset - static_cast<uint64_t>(file.tellp())));
+
+    for (size_t level = 0; level < texture.levels.size(); level++) {
+      file.write(
+        reinterpret_cast<const char*>(texture.levelData(level)),
+        static_cast<std::streamsize>(texture.levels[level].size));
+    }
+
+    if (!file) {
+      throw std::runtime_error("failed to write texture cache entry!");
+    }
+  }
+
+  std::filesystem::rename(temporaryPath, path);
+  evict();
+}
+
+void TextureCache::evict() const {
+  struct Entry {
+    std::filesystem::file_time_type lastUse;
+    uint64_t size;
+    std::filesystem::path path;
+  };
+
+  std::error_code error;
+  std::vector<Entry> entries;
+  uint64_t totalBytes = 0;
+  for (const auto& file : std::filesystem::directory_iterator(directory, error)) {
+    if (file.path().extension() != textureCacheExtension) {
+      continue;
+    }
+    std::error_code timeError;
+    std::error_code sizeError;
+    Entry entry{ file.last_write_time(timeError), file.file_size(sizeError), file.path() };
+    if (!timeError && !sizeError) {
+      entries.push_back(entry);
+      totalBytes += entry.size;
+    }
+  }
+
+  if (totalBytes <= maxBytes) {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return a.lastUse < b.lastUse;
+  });
+
+  // another loader thread may have removed an entry already, or it may be
+  // mapped (which blocks deletion on Windows); either way move on
+  for (const Entry& entry : entries) {
+    if (totalBytes <= maxBytes) {
+      break;
+    }
+    if (std::filesystem::remove(entry.path, error)) {
+      totalBytes -= entry.size;
+    }
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "texture.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// On-disk cache of decoded textures, so images are only inflated once.
+// Entries are keyed by a hash of the source file's contents together with
+// the decode settings, which makes them independent of file names and
+// timestamps. Each entry is one file in the cache directory:
+//
+//   TextureCacheHeader
+//   levelCount TextureCacheLevel entries
+//   level texels at dataOffset, packed back to back, largest first
+//
+// A hit is mapped and uploaded straight from the mapping. The directory is
+// kept under maxBytes by deleting the least recently used entries, where
+// use is tracked through the file modification times.
+const uint32_t textureCacheVersion = 1;
+const uint64_t textureCacheAlignment = 64;
+
+struct TextureCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t levelCount;
+  uint64_t dataOffset;
+};
+
+struct TextureCacheLevel {
+  uint32_t width;
+  uint32_t height;
+  uint64_t offset; // from dataOffset
+  uint64_t size;
+};
+
+class TextureCache {
+public:
+  // generateMips stores full mip chains, box filtered on the CPU, so cached
+  // textures skip the GPU blits as well
+  TextureCache(std::string directory, uint64_t maxBytes, bool generateMips);
+
+  // Hashes the contents of sourcePath together with the decode settings.
+  uint64_t key(const std::string& sourcePath) const;
+  uint64_t key(const MappedFile& source) const;
+
+  // Maps the entry for key if there is a valid one and marks it as used.
+  std::optional<TextureData> open(uint64_t key) const;
+
+  // Decodes sourcePath the way the cache stores it, without touching the
+  // cache.
+  TextureData decode(const std::string& sourcePath) const;
+  TextureData decode(const std::string& sourcePath, MappedFile&& source) const;
+
+  // Stores texture under key, then evicts entries until the cache fits.
+  // Entries are written under a temporary name and renamed into place, so
+  // concurrent readers never see half an entry.
+  void write(uint64_t key, const TextureData& texture) const;
+
+  // Deletes least recently used entries until the cache takes at most
+  // maxBytes. Entries that cannot be deleted right now are skipped.
+  void evict() const;
+
+  std::string entryPath(uint64_t key) const;
+
+private:
+  std::string directory;
+  uint64_t maxBytes;
+  bool generateMips;
+};
@@ -0,0 +1,94 @@
+#include "texture_loader.h"
+
+#include <algorithm>
+#include <chrono>
+
+TextureLoader::TextureLoader(unsigned int threadCount, std::optional<TextureCache> cache)
+  : cache(std::move(cache))
+{
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (unsigned int i = 0; i < threadCount; i++) {
+    workers.emplace_back(&TextureLoader::work, this);
+  }
+}
+
+TextureLoader::~TextureLoader() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+    queue.clear();
+  }
+  queueChanged.notify_all();
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+std::future<LoadedTexture> TextureLoader::load(const std::string& filename) {
+  std::packaged_task<LoadedTexture()> task([this, filename]() {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    LoadedTexture loaded = loadTextureWithCache(filename, cache ? &*cache : nullptr);
+    auto endTime = std::chrono::high_resolution_clock::now();
+    loaded.decodeSeconds = std::chrono::duration<float, std::chrono::seconds::period>(endTime - startTime).count();
+    return loaded;
+  });
+  std::future<LoadedTexture> result = task.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queue.push_back(std::move(task));
+  }
+  queueChanged.notify_one();
+
+  return result;
+}
+
+void TextureLoader::work() {
+  for (;;) {
+    std::packaged_task<LoadedTexture()> task;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueChanged.wait(lock, [this]() { return stopping || !queue.empty(); });
+      if (stopping) {
+        return;
+      }
+      task = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    task();
+  }
+}
+
+LoadedTexture loadTextureWithCache(const std::string& filename, const TextureCache* cache) {
+  MappedFile file(filename);
+  file.adviseSequential();
+  return loadTextureWithCache(filename, cache, std::move(file));
+}
+
+LoadedTexture loadTextureWithCache(const std::string& filename, const TextureCache* cache, MappedFile&& file) {
+  LoadedTexture loaded{};
+  if (!cache || isCompressedTextureFile(filename)) {
+    loaded.texture = loadTexture(filename, std::move(file));
+    return loaded;
+  }
+
+  uint64_t key = cache->key(file);
+  if (std::optional<TextureData> cached = cache->open(key)) {
+    loaded.texture = std::move(*cached);
+    loaded.fromCache = true;
+    return loaded;
+  }
+
+  loaded.texture = cache->decode(filename, std::move(file));
+  try {
+    cache->write(key, loaded.texture);
+  } catch (const std::exception& e) {
+    loaded.warning = std::string("failed to write texture cache: ") + e.what();
+  }
+  return loaded;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "texture.h"
+#include "texture_cache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LoadedTexture {
+  TextureData texture;
+  float decodeSeconds; // time spent loading on the worker
+  bool fromCache;
+  std::string warning; // set if the texture loaded but could not be cached
+};
+
+// Loads filename like loadTexture. With a cache, images that need decoding
+// are looked up there first and stored after decoding; decodeSeconds is left
+// for the caller to fill in.
+LoadedTexture loadTextureWithCache(const std::string& filename, const TextureCache* cache);
+// The same from filename already mapped, which is read only once whether it
+// is hashed, decoded or both.
+LoadedTexture loadTextureWithCache(const std::string& filename, const TextureCache* cache, MappedFile&& file);
+
+// Fixed pool of threads that run loadTexture in the background, so textures
+// can be decoded while the caller creates the device and swapchain. Loads
+// start in submission order; the future rethrows whatever loadTexture threw.
+// With a cache, loads go through loadTextureWithCache.
+class TextureLoader {
+public:
+  // 0 uses every hardware thread
+  explicit TextureLoader(unsigned int threadCount = 0, std::optional<TextureCache> cache = std::nullopt);
+  // loads that have not started yet are dropped, their futures report
+  // std::future_error
+  ~TextureLoader();
+
+  TextureLoader(const TextureLoader&) = delete;
+  TextureLoader& operator=(const TextureLoader&) = delete;
+
+  std::future<LoadedTexture> load(const std::string& filename);
+
+private:
+  void work();
+
+  std::optional<TextureCache> cache;
+
+  std::vector<std::thread> workers;
+  std::deque<std::packaged_task<LoadedTexture()>> queue;
+  std::mutex queueMutex;
+  std::condition_variable queueChanged;
+  bool stopping = false;
+};
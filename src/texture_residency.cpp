@@ -0,0 +1,156 @@
+#include "texture_residency.h"
+
+#include <algorithm>
+
+TextureResidency::TextureResidency(uint64_t budgetBytes, uint64_t idleFrames)
+  : budget(budgetBytes), idleFrames(idleFrames) {}
+
+ResidentTextureId TextureResidency::add(const std::vector<uint64_t>& levelSizes, uint32_t firstLevel) {
+  ResidentTextureId id = nextId++;
+  Texture& texture = textures[id];
+  texture.levelSizes = levelSizes;
+  texture.firstLevel = static_cast<uint32_t>(levelSizes.size());
+  texture.lastUsed = 0;
+  texture.changing = false;
+  texture.retryFrame = 0;
+  texture.failedReloads = 0;
+
+  setFirstLevel(texture, firstLevel);
+  return id;
+}
+
+void TextureResidency::remove(ResidentTextureId texture) {
+  auto found = textures.find(texture);
+  if (found != textures.end()) {
+    residentBytes -= residentBytesOf(found->second, found->second.firstLevel);
+    textures.erase(found);
+  }
+}
+
+void TextureResidency::used(ResidentTextureId texture, uint64_t frame) {
+  auto found = textures.find(texture);
+  if (found != textures.end()) {
+    found->second.lastUsed = std::max(found->second.lastUsed, frame);
+  }
+}
+
+std::vector<ResidencyChange> TextureResidency::trim(uint64_t frame) {
+  std::unordered_map<ResidentTextureId, uint32_t> firstLevels;
+
+  while (residentBytes > budget) {
+    // the least recently used texture that can give anything up; textures
+    // only lose their last level when they are idle
+    Texture* victim = nullptr;
+    ResidentTextureId victimId = 0;
+    for (auto& [id, texture] : textures) {
+      uint32_t levelCount = static_cast<uint32_t>(texture.levelSizes.size());
+      bool idle = frame - texture.lastUsed >= idleFrames;
+      bool canShrink = texture.firstLevel < levelCount && (idle || texture.firstLevel + 1 < levelCount);
+      if (!texture.changing && canShrink && (!victim || texture.lastUsed < victim->lastUsed)) {
+        victim = &texture;
+        victimId = id;
+      }
+    }
+    if (!victim) {
+      break;
+    }
+
+    uint32_t levelCount = static_cast<uint32_t>(victim->levelSizes.size());
+    if (frame - victim->lastUsed >= idleFrames) {
+      evictions++;
+      setFirstLevel(*victim, levelCount);
+    } else {
+      droppedLevels++;
+      setFirstLevel(*victim, victim->firstLevel + 1);
+    }
+    firstLevels[victimId] = victim->firstLevel;
+  }
+
+  std::vector<ResidencyChange> changes;
+  for (const auto& [id, firstLevel] : firstLevels) {
+    Texture& texture = textures[id];
+    texture.changing = true;
+    changes.push_back(ResidencyChange{ id, firstLevel, static_cast<uint32_t>(texture.levelSizes.size()) });
+  }
+  return changes;
+}
+
+std::vector<ResidencyChange> TextureResidency::reloads(uint64_t frame) {
+  std::vector<ResidencyChange> changes;
+
+  for (auto& [id, texture] : textures) {
+    bool wanted = texture.lastUsed + 1 >= frame;
+    if (texture.changing || texture.firstLevel == 0 || !wanted || frame < texture.retryFrame) {
+      continue;
+    }
+
+    uint64_t missingBytes = residentBytesOf(texture, 0) - residentBytesOf(texture, texture.firstLevel);
+    if (residentBytes + missingBytes > budget) {
+      continue;
+    }
+
+    reloadCount++;
+    setFirstLevel(texture, 0);
+    texture.changing = true;
+    changes.push_back(ResidencyChange{ id, 0, static_cast<uint32_t>(texture.levelSizes.size()) });
+  }
+
+  return changes;
+}
+
+void TextureResidency::settled(ResidentTextureId texture, uint32_t firstLevel) {
+  auto found = textures.find(texture);
+  if (found != textures.end()) {
+    setFirstLevel(found->second, firstLevel);
+    found->second.changing = false;
+    if (firstLevel == 0) {
+      found->second.failedReloads = 0;
+    }
+  }
+}
+
+void TextureResidency::reloadFailed(ResidentTextureId texture, uint32_t firstLevel, uint64_t frame) {
+  auto found = textures.find(texture);
+  if (found == textures.end()) {
+    return;
+  }
+
+  Texture& failed = found->second;
+  failed.retryFrame = frame + (reloadRetryFrames << std::min(failed.failedReloads, maxReloadRetryDoublings));
+  failed.failedReloads++;
+  settled(texture, firstLevel);
+}
+
+TextureResidencyStats TextureResidency::stats() const {
+  TextureResidencyStats result{};
+  result.budgetBytes = budget;
+  result.residentBytes = residentBytes;
+  result.peakResidentBytes = peakResidentBytes;
+  result.textureCount = static_cast<uint32_t>(textures.size());
+  result.evictions = evictions;
+  result.droppedLevels = droppedLevels;
+  result.reloads = reloadCount;
+
+  for (const auto& entry : textures) {
+    if (entry.second.firstLevel >= entry.second.levelSizes.size()) {
+      result.evictedCount++;
+    }
+  }
+  return result;
+}
+
+uint64_t TextureResidency::residentBytesOf(const Texture& texture, uint32_t firstLevel) {
+  uint64_t bytes = 0;
+  for (size_t level = firstLevel; level < texture.levelSizes.size(); level++) {
+    bytes += texture.levelSizes[level];
+  }
+  return bytes;
+}
+
+void TextureResidency::setFirstLevel(Texture& texture, uint32_t firstLevel) {
+  firstLevel = std::min(firstLevel, static_cast<uint32_t>(texture.levelSizes.size()));
+  residentBytes -= residentBytesOf(texture, texture.firstLevel);
+  residentBytes += residentBytesOf(texture, firstLevel);
+  texture.firstLevel = firstLevel;
+  peakResidentBytes = std::max(peakResidentBytes, residentBytes);
+}
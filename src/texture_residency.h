@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using ResidentTextureId = uint32_t;
+
+// A change TextureResidency wants made to a texture: keep its levels from
+// firstLevel on. A firstLevel past the last level evicts it.
+struct ResidencyChange {
+  ResidentTextureId texture;
+  uint32_t firstLevel;
+  uint32_t levelCount;
+};
+
+struct TextureResidencyStats {
+  uint64_t budgetBytes;
+  uint64_t residentBytes;
+  uint64_t peakResidentBytes;
+  uint32_t textureCount;
+  uint32_t evictedCount; // with no levels resident now
+  uint64_t evictions;
+  uint64_t droppedLevels;
+  uint64_t reloads;
+};
+
+// Keeps the textures on the GPU within a hard byte budget. Textures are
+// marked as used in the frames that draw with them; when they take more
+// than the budget, the least recently used ones lose their top mip levels,
+// or are evicted outright once they have been idle for idleFrames. Those
+// that are drawn with again get their levels back as soon as they fit.
+//
+// The manager only keeps the books: changes are handed out and take effect
+// in the budget at once, and the texture is left alone until the caller
+// reports the change settled.
+class TextureResidency {
+public:
+  TextureResidency(uint64_t budgetBytes, uint64_t idleFrames);
+
+  // A texture with levelSizes bytes per level, largest first, resident from
+  // firstLevel on.
+  ResidentTextureId add(const std::vector<uint64_t>& levelSizes, uint32_t firstLevel = 0);
+  void remove(ResidentTextureId texture);
+
+  void used(ResidentTextureId texture, uint64_t frame);
+
+  // Changes that bring the resident textures within budget, as far as
+  // textures that are not being changed already allow.
+  std::vector<ResidencyChange> trim(uint64_t frame);
+  // Changes that bring back all levels of textures used in the last frame
+  // that are missing some, for those that fit. A texture whose reload
+  // failed is not reloaded again until its retry frame.
+  std::vector<ResidencyChange> reloads(uint64_t frame);
+
+  // The change handed out for texture is done, or failed and left it with
+  // levels from firstLevel on.
+  void settled(ResidentTextureId texture, uint32_t firstLevel);
+  // The reload handed out for texture failed and left it with levels from
+  // firstLevel on. It is retried after reloadRetryFrames, twice as long
+  // after each further failure in a row, up to maxReloadRetryDoublings times.
+  void reloadFailed(ResidentTextureId texture, uint32_t firstLevel, uint64_t frame);
+
+  TextureResidencyStats stats() const;
+
+private:
+  struct Texture {
+    std::vector<uint64_t> levelSizes;
+    uint32_t firstLevel;
+    uint64_t lastUsed;
+    bool changing;
+    uint64_t retryFrame; // reloads wait until this frame after a failure
+    uint32_t failedReloads; // in a row
+  };
+
+  static constexpr uint64_t reloadRetryFrames = 60;
+  static constexpr uint32_t maxReloadRetryDoublings = 6;
+
+  static uint64_t residentBytesOf(const Texture& texture, uint32_t firstLevel);
+  void setFirstLevel(Texture& texture, uint32_t firstLevel);
+
+  uint64_t budget;
+  uint64_t idleFrames;
+
+  std::unordered_map<ResidentTextureId, Texture> textures;
+  ResidentTextureId nextId = 1;
+
+  uint64_t residentBytes = 0;
+  uint64_t peakResidentBytes = 0;
+  uint64_t evictions = 0;
+  uint64_t droppedLevels = 0;
+  uint64_t reloadCount = 0;
+};
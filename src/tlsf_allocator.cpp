@@ -0,0 +1,292 @@
+#include "tlsf_allocator.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+uint32_t highestBit(uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return index;
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+uint32_t lowestBit(uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return index;
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Whether the bytes at a and b fall in the same page of pageSize.
+bool samePage(uint64_t a, uint64_t b, uint64_t pageSize) {
+  return a / pageSize == b / pageSize;
+}
+
+} // namespace
+
+TlsfAllocator::TlsfAllocator(uint64_t size, uint64_t bufferImageGranularity)
+  : totalSize(size), granularity(std::max<uint64_t>(bufferImageGranularity, 1))
+{
+  for (auto& lists : freeLists) {
+    std::fill(std::begin(lists), std::end(lists), none);
+  }
+
+  if (size > 0) {
+    uint32_t node = newNode();
+    nodes[node] = Node{ 0, size, none, none, none, none, true, false };
+    insertFree(node);
+  }
+}
+
+std::optional<TlsfAllocation> TlsfAllocator::allocate(uint64_t size, uint64_t alignment, bool linear) {
+  if (size == 0 || size > totalSize) {
+    return std::nullopt;
+  }
+
+  // look where ranges fit however much they need padding first, so the
+  // first one tried fits; ranges that fit with less padding than the worst
+  // are only searched for when nothing that large is free
+  uint64_t worstPadding = alignment - 1 + (granularity > 1 ? granularity - 1 : 0);
+  std::optional<TlsfAllocation> allocation;
+  if (worstPadding < totalSize - size) {
+    allocation = allocateFrom(size + worstPadding, size, alignment, linear);
+  }
+  if (!allocation && worstPadding > 0) {
+    allocation = allocateFrom(size, size, alignment, linear);
+  }
+  return allocation;
+}
+
+std::optional<TlsfAllocation> TlsfAllocator::allocateFrom(uint64_t searchSize, uint64_t size, uint64_t alignment, bool linear) {
+  // start at the first bin whose ranges are all at least searchSize
+  uint32_t firstLevel, secondLevel;
+  binOf(searchSize, firstLevel, secondLevel);
+  if (firstLevel >= secondLevelBits) {
+    uint64_t binWidth = uint64_t(1) << (firstLevel - secondLevelBits);
+    binOf(searchSize + binWidth - 1, firstLevel, secondLevel);
+  }
+
+  while (nextNonEmptyBin(firstLevel, secondLevel)) {
+    for (uint32_t node = freeLists[firstLevel][secondLevel]; node != none; node = nodes[node].nextFree) {
+      uint64_t offset;
+      if (fits(node, size, alignment, linear, offset)) {
+        return use(node, offset, size, linear);
+      }
+    }
+
+    if (++secondLevel == secondLevelCount) {
+      secondLevel = 0;
+      if (++firstLevel == firstLevelCount) {
+        break;
+      }
+    }
+  }
+
+  return std::nullopt;
+}
+
+void TlsfAllocator::free(uint32_t node) {
+  used -= nodes[node].size;
+  allocations--;
+  nodes[node].free = true;
+
+  uint32_t next = nodes[node].next;
+  if (next != none && nodes[next].free) {
+    removeFree(next);
+    nodes[node].size += nodes[next].size;
+    nodes[node].next = nodes[next].next;
+    if (nodes[node].next != none) {
+      nodes[nodes[node].next].previous = node;
+    }
+    unusedNodes.push_back(next);
+  }
+
+  uint32_t previous = nodes[node].previous;
+  if (previous != none && nodes[previous].free) {
+    removeFree(previous);
+    nodes[previous].size += nodes[node].size;
+    nodes[previous].next = nodes[node].next;
+    if (nodes[previous].next != none) {
+      nodes[nodes[previous].next].previous = previous;
+    }
+    unusedNodes.push_back(node);
+    node = previous;
+  }
+
+  insertFree(node);
+}
+
+uint64_t TlsfAllocator::largestFreeRange() const {
+  if (firstLevelBitmap == 0) {
+    return 0;
+  }
+
+  uint32_t firstLevel = highestBit(firstLevelBitmap);
+  uint32_t secondLevel = highestBit(secondLevelBitmaps[firstLevel]);
+
+  uint64_t largest = 0;
+  for (uint32_t node = freeLists[firstLevel][secondLevel]; node != none; node = nodes[node].nextFree) {
+    largest = std::max(largest, nodes[node].size);
+  }
+  return largest;
+}
+
+// The top secondLevelBits bits below the highest one pick the bin within its
+// power of two. Sizes below secondLevelCount each get a bin of their own.
+void TlsfAllocator::binOf(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel) {
+  firstLevel = highestBit(size);
+  if (firstLevel >= secondLevelBits) {
+    secondLevel = static_cast<uint32_t>(size >> (firstLevel - secondLevelBits)) & (secondLevelCount - 1);
+  } else {
+    secondLevel = static_cast<uint32_t>(size << (secondLevelBits - firstLevel)) & (secondLevelCount - 1);
+  }
+}
+
+// Moves to the first bin at or after the given one that has free ranges.
+bool TlsfAllocator::nextNonEmptyBin(uint32_t& firstLevel, uint32_t& secondLevel) const {
+  uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+  if (secondLevelMap == 0) {
+    if (firstLevel + 1 == firstLevelCount) {
+      return false;
+    }
+    uint64_t firstLevelMap = firstLevelBitmap & (~uint64_t(0) << (firstLevel + 1));
+    if (firstLevelMap == 0) {
+      return false;
+    }
+    firstLevel = lowestBit(firstLevelMap);
+    secondLevelMap = secondLevelBitmaps[firstLevel];
+  }
+
+  secondLevel = lowestBit(secondLevelMap);
+  return true;
+}
+
+bool TlsfAllocator::fits(uint32_t node, uint64_t size, uint64_t alignment, bool linear, uint64_t& offset) const {
+  const Node& range = nodes[node];
+  uint64_t start = alignUp(range.offset, alignment);
+
+  if (granularity > 1 && range.previous != none) {
+    const Node& previous = nodes[range.previous];
+    if (previous.linear != linear && samePage(previous.offset + previous.size - 1, start, granularity)) {
+      start = alignUp(start, granularity);
+    }
+  }
+
+  uint64_t end = range.offset + range.size;
+  if (start >= end || size > end - start) {
+    return false;
+  }
+
+  if (granularity > 1 && range.next != none) {
+    const Node& next = nodes[range.next];
+    if (next.linear != linear && samePage(start + size - 1, next.offset, granularity)) {
+      return false;
+    }
+  }
+
+  offset = start;
+  return true;
+}
+
+// Carves [offset, offset + size) out of a free range, returning what is left
+// on either side to the free lists.
+TlsfAllocation TlsfAllocator::use(uint32_t node, uint64_t offset, uint64_t size, bool linear) {
+  removeFree(node);
+
+  if (offset > nodes[node].offset) {
+    uint32_t padding = newNode();
+    nodes[padding] = Node{
+      nodes[node].offset, offset - nodes[node].offset, nodes[node].previous, node, none, none, true, false };
+    if (nodes[padding].previous != none) {
+      nodes[nodes[padding].previous].next = padding;
+    }
+    nodes[node].previous = padding;
+    nodes[node].size -= nodes[padding].size;
+    nodes[node].offset = offset;
+    insertFree(padding);
+  }
+
+  if (nodes[node].size > size) {
+    uint32_t rest = newNode();
+    nodes[rest] = Node{ offset + size, nodes[node].size - size, node, nodes[node].next, none, none, true, false };
+    if (nodes[rest].next != none) {
+      nodes[nodes[rest].next].previous = rest;
+    }
+    nodes[node].next = rest;
+    nodes[node].size = size;
+    insertFree(rest);
+  }
+
+  nodes[node].free = false;
+  nodes[node].linear = linear;
+  used += size;
+  allocations++;
+
+  return TlsfAllocation{ node, offset };
+}
+
+uint32_t TlsfAllocator::newNode() {
+  if (!unusedNodes.empty()) {
+    uint32_t node = unusedNodes.back();
+    unusedNodes.pop_back();
+    return node;
+  }
+
+  nodes.emplace_back();
+  return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void TlsfAllocator::insertFree(uint32_t node) {
+  uint32_t firstLevel, secondLevel;
+  binOf(nodes[node].size, firstLevel, secondLevel);
+
+  uint32_t& head = freeLists[firstLevel][secondLevel];
+  nodes[node].previousFree = none;
+  nodes[node].nextFree = head;
+  if (head != none) {
+    nodes[head].previousFree = node;
+  }
+  head = node;
+
+  firstLevelBitmap |= uint64_t(1) << firstLevel;
+  secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+  freeRanges++;
+}
+
+void TlsfAllocator::removeFree(uint32_t node) {
+  uint32_t firstLevel, secondLevel;
+  binOf(nodes[node].size, firstLevel, secondLevel);
+
+  const Node& range = nodes[node];
+  if (range.previousFree != none) {
+    nodes[range.previousFree].nextFree = range.nextFree;
+  } else {
+    freeLists[firstLevel][secondLevel] = range.nextFree;
+  }
+  if (range.nextFree != none) {
+    nodes[range.nextFree].previousFree = range.previousFree;
+  }
+
+  if (freeLists[firstLevel][secondLevel] == none) {
+    secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+    if (secondLevelBitmaps[firstLevel] == 0) {
+      firstLevelBitmap &= ~(uint64_t(1) << firstLevel);
+    }
+  }
+  freeRanges--;
+}
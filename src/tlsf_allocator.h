@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// A range handed out by TlsfAllocator.
+struct TlsfAllocation {
+  uint32_t node; // for free
+  uint64_t offset;
+};
+
+// Two-level segregated fit allocator for the ranges of one block of memory.
+// Free ranges are binned by the power of two of their size and then 16 ways
+// within it, with a bitmap per level, so finding one that fits and freeing
+// one (merging it with free neighbours) take the same time however many
+// ranges are live.
+//
+// Ranges are linear (buffers, linear images) or not (optimal tiling images).
+// Where the two kinds meet they are kept bufferImageGranularity pages apart,
+// as Vulkan requires of resources that share a VkDeviceMemory.
+class TlsfAllocator {
+public:
+  explicit TlsfAllocator(uint64_t size, uint64_t bufferImageGranularity = 1);
+
+  // nullopt when no free range fits; alignment must be a power of two
+  std::optional<TlsfAllocation> allocate(uint64_t size, uint64_t alignment, bool linear);
+  void free(uint32_t node);
+
+  uint64_t size() const { return totalSize; }
+  uint64_t usedBytes() const { return used; }
+  uint32_t allocationCount() const { return allocations; }
+  uint32_t freeRangeCount() const { return freeRanges; }
+  uint64_t largestFreeRange() const;
+
+private:
+  static constexpr uint32_t secondLevelBits = 4;
+  static constexpr uint32_t secondLevelCount = 1u << secondLevelBits;
+  static constexpr uint32_t firstLevelCount = 64;
+  static constexpr uint32_t none = UINT32_MAX;
+
+  struct Node {
+    uint64_t offset;
+    uint64_t size;
+    // physical neighbours; those of a free range are always in use, since
+    // free neighbours are merged
+    uint32_t previous;
+    uint32_t next;
+    // in its free list
+    uint32_t previousFree;
+    uint32_t nextFree;
+    bool free;
+    bool linear;
+  };
+
+  static void binOf(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+  std::optional<TlsfAllocation> allocateFrom(uint64_t searchSize, uint64_t size, uint64_t alignment, bool linear);
+  bool nextNonEmptyBin(uint32_t& firstLevel, uint32_t& secondLevel) const;
+  bool fits(uint32_t node, uint64_t size, uint64_t alignment, bool linear, uint64_t& offset) const;
+  TlsfAllocation use(uint32_t node, uint64_t offset, uint64_t size, bool linear);
+
+  uint32_t newNode();
+  void insertFree(uint32_t node);
+  void removeFree(uint32_t node);
+
+  uint64_t totalSize;
+  uint64_t granularity;
+  uint64_t used = 0;
+  uint32_t allocations = 0;
+  uint32_t freeRanges = 0;
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> unusedNodes;
+
+  uint64_t firstLevelBitmap = 0;
+  uint32_t secondLevelBitmaps[firstLevelCount] = {};
+  uint32_t freeLists[firstLevelCount][secondLevelCount];
+};
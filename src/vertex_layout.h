@@ -0,0 +1,179 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Compile-time vertex layout reflection. A vertex struct declares its
+// attributes once, in shader location order:
+//
+//   static constexpr auto stream() {
+//     return vertexStream<Vertex>(
+//       VERTEX_ATTRIBUTE(Vertex, pos),
+//       VERTEX_ATTRIBUTE(Vertex, texCoord),
+//       VERTEX_ATTRIBUTE_AS(Vertex, color, VK_FORMAT_R8G8B8A8_UNORM));
+//   }
+//
+// and the Vulkan binding and attribute descriptions are derived from that.
+// Interleaved layouts are one stream; for multi-stream layouts every stream
+// becomes its own binding, numbered in the order they are passed, and
+// locations continue across streams. Everything is constexpr, so a layout
+// that does not fit its members fails to compile.
+
+// VkFormat of a vertex attribute member of type T, or VK_FORMAT_UNDEFINED
+// for types without an unambiguous mapping (integers that could be read
+// normalized or not); those need VERTEX_ATTRIBUTE_AS.
+template<typename T> constexpr VkFormat vertexAttributeFormat = VK_FORMAT_UNDEFINED;
+template<> constexpr VkFormat vertexAttributeFormat<float> = VK_FORMAT_R32_SFLOAT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::vec2> = VK_FORMAT_R32G32_SFLOAT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::vec3> = VK_FORMAT_R32G32B32_SFLOAT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::vec4> = VK_FORMAT_R32G32B32A32_SFLOAT;
+template<> constexpr VkFormat vertexAttributeFormat<int32_t> = VK_FORMAT_R32_SINT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::ivec2> = VK_FORMAT_R32G32_SINT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::ivec3> = VK_FORMAT_R32G32B32_SINT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::ivec4> = VK_FORMAT_R32G32B32A32_SINT;
+template<> constexpr VkFormat vertexAttributeFormat<uint32_t> = VK_FORMAT_R32_UINT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::uvec2> = VK_FORMAT_R32G32_UINT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::uvec3> = VK_FORMAT_R32G32B32_UINT;
+template<> constexpr VkFormat vertexAttributeFormat<glm::uvec4> = VK_FORMAT_R32G32B32A32_UINT;
+
+// Size in bytes of one element of the vertex formats this project uses, or
+// zero for formats it does not know about.
+constexpr uint32_t vertexFormatSize(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SNORM:
+    case VK_FORMAT_R8G8B8A8_UINT:
+    case VK_FORMAT_A2B10G10R10_SNORM_PACK32:
+    case VK_FORMAT_R16G16_UNORM:
+    case VK_FORMAT_R16G16_SNORM:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+    case VK_FORMAT_R32_SINT:
+    case VK_FORMAT_R32_UINT:
+      return 4;
+    case VK_FORMAT_R16G16B16A16_UNORM:
+    case VK_FORMAT_R16G16B16A16_SNORM:
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+    case VK_FORMAT_R32G32_SINT:
+    case VK_FORMAT_R32G32_UINT:
+      return 8;
+    case VK_FORMAT_R32G32B32_SFLOAT:
+    case VK_FORMAT_R32G32B32_SINT:
+    case VK_FORMAT_R32G32B32_UINT:
+      return 12;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+    case VK_FORMAT_R32G32B32A32_SINT:
+    case VK_FORMAT_R32G32B32A32_UINT:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+struct VertexAttribute {
+  VkFormat format;
+  uint32_t offset;
+  uint32_t size; // of the member, checked against the format
+};
+
+// Throwing in a function that is evaluated at compile time is a compile
+// error, which is how the checks below report a bad layout.
+template<typename Member>
+constexpr VertexAttribute vertexAttribute(size_t offset, VkFormat format = vertexAttributeFormat<Member>) {
+  return format == VK_FORMAT_UNDEFINED
+    ? throw std::logic_error("no VkFormat for this member type, use VERTEX_ATTRIBUTE_AS!")
+    : vertexFormatSize(format) != sizeof(Member)
+      ? throw std::logic_error("vertex attribute format does not match the member size!")
+      : VertexAttribute{ format, static_cast<uint32_t>(offset), static_cast<uint32_t>(sizeof(Member)) };
+}
+
+#define VERTEX_ATTRIBUTE(Type, member) \
+  vertexAttribute<decltype(Type::member)>(offsetof(Type, member))
+
+#define VERTEX_ATTRIBUTE_AS(Type, member, format) \
+  vertexAttribute<decltype(Type::member)>(offsetof(Type, member), format)
+
+// One vertex buffer binding: a struct of stride bytes and the attributes
+// read from it.
+template<size_t AttributeCount>
+struct VertexStream {
+  static constexpr size_t attributeCount = AttributeCount;
+
+  uint32_t stride;
+  VkVertexInputRate inputRate;
+  std::array<VertexAttribute, AttributeCount> attributes;
+};
+
+template<typename Vertex, typename... Attributes>
+constexpr VertexStream<sizeof...(Attributes)> vertexStream(Attributes... attributes) {
+  return { static_cast<uint32_t>(sizeof(Vertex)), VK_VERTEX_INPUT_RATE_VERTEX, { attributes... } };
+}
+
+template<typename... Streams>
+constexpr std::array<VkVertexInputBindingDescription, sizeof...(Streams)>
+vertexBindingDescriptions(const Streams&... streams) {
+  std::array<VkVertexInputBindingDescription, sizeof...(Streams)> bindingDescriptions{};
+  uint32_t binding = 0;
+  ((bindingDescriptions[binding] = VkVertexInputBindingDescription{ binding, streams.stride, streams.inputRate },
+    binding++), ...);
+  return bindingDescriptions;
+}
+
+template<size_t Count, size_t AttributeCount>
+constexpr void appendVertexAttributeDescriptions(
+  std::array<VkVertexInputAttributeDescription, Count>& attributeDescriptions,
+  uint32_t& location,
+  uint32_t binding,
+  const VertexStream<AttributeCount>& stream)
+{
+  for (const VertexAttribute& attribute : stream.attributes) {
+    if (attribute.offset + attribute.size > stream.stride) {
+      throw std::logic_error("vertex attribute lies outside its stream!");
+    }
+    attributeDescriptions[location] =
+      VkVertexInputAttributeDescription{ location, binding, attribute.format, attribute.offset };
+    location++;
+  }
+}
+
+// Whether a derived description is exactly the one given, for checking
+// layouts in static_asserts.
+constexpr bool isVertexBinding(
+  const VkVertexInputBindingDescription& description,
+  uint32_t binding,
+  uint32_t stride)
+{
+  return description.binding == binding
+    && description.stride == stride
+    && description.inputRate == VK_VERTEX_INPUT_RATE_VERTEX;
+}
+
+constexpr bool isVertexAttribute(
+  const VkVertexInputAttributeDescription& description,
+  uint32_t location,
+  uint32_t binding,
+  VkFormat format,
+  size_t offset)
+{
+  return description.location == location
+    && description.binding == binding
+    && description.format == format
+    && description.offset == offset;
+}
+
+template<typename... Streams>
+constexpr std::array<VkVertexInputAttributeDescription, (Streams::attributeCount + ... + 0)>
+vertexAttributeDescriptions(const Streams&... streams) {
+  std::array<VkVertexInputAttributeDescription, (Streams::attributeCount + ... + 0)> attributeDescriptions{};
+  uint32_t location = 0;
+  uint32_t binding = 0;
+  (appendVertexAttributeDescriptions(attributeDescriptions, location, binding++, streams), ...);
+  return attributeDescriptions;
+}
@@ -0,0 +1,192 @@
+#include "vertex_quantization.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Scale that maps [center - extent, center + extent] onto [-1, 1], guarding
+// against flat meshes.
+float safeExtent(float extent) {
+  return extent > 0.0f ? extent : 1.0f;
+}
+
+float signNotZero(float value) {
+  return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+} // namespace
+
+QuantizedVertices quantizeVertices(const Vertex* vertices, size_t vertexCount, VertexFormat format) {
+  QuantizedVertices quantized;
+  quantized.vertices.resize(vertexCount);
+  quantized.dequantization.positionScale = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+  quantized.dequantization.positionOffset = glm::vec4(0.0f);
+  quantized.dequantization.texCoordScaleOffset = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+
+  glm::vec3 positionCenter(0.0f);
+  glm::vec3 positionExtent(1.0f);
+  glm::vec2 texCoordMin(0.0f);
+  glm::vec2 texCoordExtent(1.0f);
+
+  if (format == VertexFormat::Snorm16 && vertexCount > 0) {
+    glm::vec3 boundsMin = vertices[0].pos;
+    glm::vec3 boundsMax = vertices[0].pos;
+    texCoordMin = vertices[0].texCoord;
+    glm::vec2 texCoordMax = vertices[0].texCoord;
+
+    for (size_t i = 1; i < vertexCount; i++) {
+      boundsMin = glm::min(boundsMin, vertices[i].pos);
+      boundsMax = glm::max(boundsMax, vertices[i].pos);
+      texCoordMin = glm::min(texCoordMin, vertices[i].texCoord);
+      texCoordMax = glm::max(texCoordMax, vertices[i].texCoord);
+    }
+
+    positionCenter = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 halfSize = (boundsMax - boundsMin) * 0.5f;
+    positionExtent = glm::vec3(safeExtent(halfSize.x), safeExtent(halfSize.y), safeExtent(halfSize.z));
+    glm::vec2 texCoordSize = texCoordMax - texCoordMin;
+    texCoordExtent = glm::vec2(safeExtent(texCoordSize.x), safeExtent(texCoordSize.y));
+
+    quantized.dequantization.positionScale = glm::vec4(positionExtent, 0.0f);
+    quantized.dequantization.positionOffset = glm::vec4(positionCenter, 0.0f);
+    quantized.dequantization.texCoordScaleOffset =
+      glm::vec4(texCoordExtent.x, texCoordExtent.y, texCoordMin.x, texCoordMin.y);
+  }
+
+  for (size_t i = 0; i < vertexCount; i++) {
+    const Vertex& vertex = vertices[i];
+    PackedVertex& packed = quantized.vertices[i];
+
+    if (format == VertexFormat::Snorm16) {
+      glm::vec3 position = (vertex.pos - positionCenter) / positionExtent;
+      glm::vec2 texCoord = (vertex.texCoord - texCoordMin) / texCoordExtent;
+      for (int c = 0; c < 3; c++) {
+        packed.pos[c] = glm::packSnorm1x16(position[c]);
+      }
+      packed.texCoord[0] = glm::packUnorm1x16(texCoord.x);
+      packed.texCoord[1] = glm::packUnorm1x16(texCoord.y);
+    } else {
+      for (int c = 0; c < 3; c++) {
+        packed.pos[c] = glm::packHalf1x16(vertex.pos[c]);
+      }
+      packed.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+      packed.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+    }
+    packed.pos[3] = 0;
+
+    for (int c = 0; c < 3; c++) {
+      packed.color[c] = glm::packUnorm1x8(vertex.color[c]);
+    }
+    packed.color[3] = UINT8_MAX;
+  }
+
+  return quantized;
+}
+
+Vertex dequantizeVertex(
+  const PackedVertex& packed,
+  const VertexDequantization& dequantization,
+  VertexFormat format)
+{
+  Vertex vertex{};
+
+  glm::vec3 position;
+  glm::vec2 texCoord;
+  if (format == VertexFormat::Snorm16) {
+    for (int c = 0; c < 3; c++) {
+      position[c] = glm::unpackSnorm1x16(packed.pos[c]);
+    }
+    texCoord = glm::vec2(glm::unpackUnorm1x16(packed.texCoord[0]), glm::unpackUnorm1x16(packed.texCoord[1]));
+  } else {
+    for (int c = 0; c < 3; c++) {
+      position[c] = glm::unpackHalf1x16(packed.pos[c]);
+    }
+    texCoord = glm::vec2(glm::unpackHalf1x16(packed.texCoord[0]), glm::unpackHalf1x16(packed.texCoord[1]));
+  }
+
+  const glm::vec4& scale = dequantization.positionScale;
+  const glm::vec4& offset = dequantization.positionOffset;
+  const glm::vec4& texCoordScaleOffset = dequantization.texCoordScaleOffset;
+  vertex.pos = position * glm::vec3(scale.x, scale.y, scale.z) + glm::vec3(offset.x, offset.y, offset.z);
+  vertex.texCoord = texCoord * glm::vec2(texCoordScaleOffset.x, texCoordScaleOffset.y)
+    + glm::vec2(texCoordScaleOffset.z, texCoordScaleOffset.w);
+
+  for (int c = 0; c < 3; c++) {
+    vertex.color[c] = glm::unpackUnorm1x8(packed.color[c]);
+  }
+
+  return vertex;
+}
+
+QuantizationError measureQuantizationError(
+  const Vertex* vertices,
+  size_t vertexCount,
+  const QuantizedVertices& quantized,
+  VertexFormat format)
+{
+  QuantizationError error{};
+  if (vertexCount == 0) {
+    return error;
+  }
+
+  glm::vec3 boundsMin = vertices[0].pos;
+  glm::vec3 boundsMax = vertices[0].pos;
+  double squaredErrorSum = 0.0;
+
+  for (size_t i = 0; i < vertexCount; i++) {
+    const Vertex& original = vertices[i];
+    Vertex decoded = dequantizeVertex(quantized.vertices[i], quantized.dequantization, format);
+
+    boundsMin = glm::min(boundsMin, original.pos);
+    boundsMax = glm::max(boundsMax, original.pos);
+
+    float positionError = glm::distance(original.pos, decoded.pos);
+    squaredErrorSum += positionError * positionError;
+    error.maxPositionError = std::max(error.maxPositionError, positionError);
+
+    glm::vec2 texCoordError = glm::abs(original.texCoord - decoded.texCoord);
+    error.maxTexCoordError = std::max(error.maxTexCoordError, std::max(texCoordError.x, texCoordError.y));
+
+    for (int c = 0; c < 3; c++) {
+      error.maxColorError = std::max(error.maxColorError, std::abs(original.color[c] - decoded.color[c]));
+    }
+  }
+
+  error.rmsPositionError = static_cast<float>(std::sqrt(squaredErrorSum / vertexCount));
+  float diagonal = glm::distance(boundsMin, boundsMax);
+  error.relativePositionError = diagonal > 0.0f ? error.maxPositionError / diagonal : 0.0f;
+
+  return error;
+}
+
+uint32_t encodeOctahedralNormal(glm::vec3 normal) {
+  // project onto the octahedron |x| + |y| + |z| = 1, then fold the lower
+  // half over the diagonals so the whole sphere covers the [-1, 1] square
+  normal = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+
+  glm::vec2 encoded(normal.x, normal.y);
+  if (normal.z < 0.0f) {
+    encoded = glm::vec2(
+      (1.0f - std::abs(normal.y)) * signNotZero(normal.x),
+      (1.0f - std::abs(normal.x)) * signNotZero(normal.y));
+  }
+
+  return glm::packSnorm1x16(encoded.x) | (static_cast<uint32_t>(glm::packSnorm1x16(encoded.y)) << 16);
+}
+
+glm::vec3 decodeOctahedralNormal(uint32_t encoded) {
+  glm::vec2 folded(
+    glm::unpackSnorm1x16(static_cast<uint16_t>(encoded & 0xffff)),
+    glm::unpackSnorm1x16(static_cast<uint16_t>(encoded >> 16)));
+
+  glm::vec3 normal(folded.x, folded.y, 1.0f - std::abs(folded.x) - std::abs(folded.y));
+  if (normal.z < 0.0f) {
+    normal.x = (1.0f - std::abs(folded.y)) * signNotZero(folded.x);
+    normal.y = (1.0f - std::abs(folded.x)) * signNotZero(folded.y);
+  }
+
+  return glm::normalize(normal);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Layouts the vertex buffer can be uploaded in. Meshes are loaded as Vertex
+// and packed once at import; the mesh cache keeps the packed form.
+enum class VertexFormat {
+  Float32, // Vertex as is, 32 bytes
+  Snorm16, // PackedVertex with snorm16 positions and unorm16 texture coordinates
+  Half,    // PackedVertex with half float positions and texture coordinates
+};
+
+// 16-byte vertex shared by the packed formats; the VertexFormat decides how
+// the 16-bit fields are interpreted. Colors are unorm8 in both.
+struct PackedVertex {
+  uint16_t pos[4]; // w is padding, three-component 16-bit vertex formats are poorly supported
+  uint8_t color[4]; // alpha is always opaque
+  uint16_t texCoord[2];
+
+  static constexpr VertexStream<3> stream(VertexFormat format) {
+    bool half = format == VertexFormat::Half;
+    return vertexStream<PackedVertex>(
+      VERTEX_ATTRIBUTE_AS(PackedVertex, pos, half ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R16G16B16A16_SNORM),
+      VERTEX_ATTRIBUTE_AS(PackedVertex, color, VK_FORMAT_R8G8B8A8_UNORM),
+      VERTEX_ATTRIBUTE_AS(PackedVertex, texCoord, half ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16_UNORM));
+  }
+
+  static constexpr VkVertexInputBindingDescription getBindingDescription() {
+    return vertexBindingDescriptions(stream(VertexFormat::Snorm16))[0];
+  }
+
+  static constexpr std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions(VertexFormat format) {
+    return vertexAttributeDescriptions(stream(format));
+  }
+};
+
+// The two upload streams of a PackedVertex, see VertexPosition.
+struct PackedPosition {
+  uint16_t pos[4];
+
+  static constexpr VertexStream<1> stream(VertexFormat format) {
+    return vertexStream<PackedPosition>(VERTEX_ATTRIBUTE_AS(
+      PackedPosition,
+      pos,
+      format == VertexFormat::Half ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R16G16B16A16_SNORM));
+  }
+};
+
+struct PackedAttributes {
+  uint8_t color[4];
+  uint16_t texCoord[2];
+
+  static constexpr VertexStream<2> stream(VertexFormat format) {
+    return vertexStream<PackedAttributes>(
+      VERTEX_ATTRIBUTE_AS(PackedAttributes, color, VK_FORMAT_R8G8B8A8_UNORM),
+      VERTEX_ATTRIBUTE_AS(
+        PackedAttributes,
+        texCoord,
+        format == VertexFormat::Half ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16_UNORM));
+  }
+};
+
+static_assert(PackedVertex::getAttributeDescriptions(VertexFormat::Snorm16).size() == 3);
+static_assert(PackedVertex::getAttributeDescriptions(VertexFormat::Half).size() == 3);
+
+// the same as the hand-written offsetof tables they replaced
+static_assert(isVertexBinding(PackedVertex::getBindingDescription(), 0, sizeof(PackedVertex)));
+static_assert(isVertexAttribute(
+  PackedVertex::getAttributeDescriptions(VertexFormat::Snorm16)[0],
+  0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, pos)));
+static_assert(isVertexAttribute(
+  PackedVertex::getAttributeDescriptions(VertexFormat::Snorm16)[1],
+  1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color)));
+static_assert(isVertexAttribute(
+  PackedVertex::getAttributeDescriptions(VertexFormat::Snorm16)[2],
+  2, 0, VK_FORMAT_R16G16_UNORM, offsetof(PackedVertex, texCoord)));
+static_assert(isVertexAttribute(
+  PackedVertex::getAttributeDescriptions(VertexFormat::Half)[0],
+  0, 0, VK_FORMAT_R16G16B16A16_SFLOAT, offsetof(PackedVertex, pos)));
+static_assert(isVertexAttribute(
+  PackedVertex::getAttributeDescriptions(VertexFormat::Half)[1],
+  1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color)));
+static_assert(isVertexAttribute(
+  PackedVertex::getAttributeDescriptions(VertexFormat::Half)[2],
+  2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, texCoord)));
+static_assert(vertexAttributeDescriptions(
+  PackedPosition::stream(VertexFormat::Snorm16),
+  PackedAttributes::stream(VertexFormat::Snorm16)).size() == 3);
+
+// Per-mesh transform from the packed values back to model space, passed to
+// shader_quantized.vert as push constants:
+//
+//   position = packed.xyz * positionScale.xyz + positionOffset.xyz
+//   texCoord = packed.xy * texCoordScaleOffset.xy + texCoordScaleOffset.zw
+struct VertexDequantization {
+  glm::vec4 positionScale;
+  glm::vec4 positionOffset;
+  glm::vec4 texCoordScaleOffset;
+};
+
+struct QuantizedVertices {
+  std::vector<PackedVertex> vertices;
+  VertexDequantization dequantization;
+};
+
+// Packs vertices for format, which must not be Float32. Snorm16 maps the
+// mesh bounds onto [-1, 1] and the texture coordinate bounds onto [0, 1];
+// Half stores values as they are and gets an identity transform.
+QuantizedVertices quantizeVertices(const Vertex* vertices, size_t vertexCount, VertexFormat format);
+
+// What the vertex shader will see for a packed vertex.
+Vertex dequantizeVertex(
+  const PackedVertex& packed,
+  const VertexDequantization& dequantization,
+  VertexFormat format);
+
+struct QuantizationError {
+  float maxPositionError; // in model units
+  float rmsPositionError;
+  float relativePositionError; // maxPositionError over the bounding box diagonal
+  float maxTexCoordError;
+  float maxColorError;
+};
+
+QuantizationError measureQuantizationError(
+  const Vertex* vertices,
+  size_t vertexCount,
+  const QuantizedVertices& quantized,
+  VertexFormat format);
+
+// Octahedral normal encoding as two snorm16 values in one word, for when
+// Vertex gains normals. Decoding is cheap enough to do in the vertex shader.
+uint32_t encodeOctahedralNormal(glm::vec3 normal);
+glm::vec3 decodeOctahedralNormal(uint32_t encoded);
@@ -0,0 +1,81 @@
+#include "vertex_streams.h"
+
+#include <cstring>
+
+namespace {
+
+template<typename Position, typename Attributes>
+void resizeStreams(VertexStreams& streams, size_t vertexCount) {
+  streams.positions.resize(vertexCount * sizeof(Position));
+  streams.attributes.resize(vertexCount * sizeof(Attributes));
+}
+
+} // namespace
+
+VertexStreams splitVertexStreams(const Vertex* vertices, size_t vertexCount) {
+  VertexStreams streams;
+  resizeStreams<VertexPosition, VertexAttributes>(streams, vertexCount);
+
+  auto* positions = reinterpret_cast<VertexPosition*>(streams.positions.data());
+  auto* attributes = reinterpret_cast<VertexAttributes*>(streams.attributes.data());
+  for (size_t i = 0; i < vertexCount; i++) {
+    positions[i].pos = vertices[i].pos;
+    attributes[i].color = vertices[i].color;
+    attributes[i].texCoord = vertices[i].texCoord;
+  }
+
+  return streams;
+}
+
+VertexStreams splitVertexStreams(const std::vector<PackedVertex>& vertices) {
+  VertexStreams streams;
+  resizeStreams<PackedPosition, PackedAttributes>(streams, vertices.size());
+
+  auto* positions = reinterpret_cast<PackedPosition*>(streams.positions.data());
+  auto* attributes = reinterpret_cast<PackedAttributes*>(streams.attributes.data());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    memcpy(positions[i].pos, vertices[i].pos, sizeof(positions[i].pos));
+    memcpy(attributes[i].color, vertices[i].color, sizeof(attributes[i].color));
+    memcpy(attributes[i].texCoord, vertices[i].texCoord, sizeof(attributes[i].texCoord));
+  }
+
+  return streams;
+}
+
+UploadVertices prepareUploadVertices(
+  const Vertex* vertices,
+  size_t vertexCount,
+  VertexFormat format,
+  QuantizationError* error)
+{
+  UploadVertices prepared;
+  prepared.format = format;
+  prepared.vertexCount = vertexCount;
+
+  if (format == VertexFormat::Float32) {
+    prepared.streams = splitVertexStreams(vertices, vertexCount);
+    return prepared;
+  }
+
+  QuantizedVertices quantized = quantizeVertices(vertices, vertexCount, format);
+  if (error) {
+    *error = measureQuantizationError(vertices, vertexCount, quantized, format);
+  }
+  prepared.dequantization = quantized.dequantization;
+  prepared.streams = splitVertexStreams(quantized.vertices);
+  return prepared;
+}
+
+VertexInputLayout vertexInputLayout(VertexFormat format) {
+  if (format == VertexFormat::Float32) {
+    return {
+      vertexBindingDescriptions(VertexPosition::stream(), VertexAttributes::stream()),
+      vertexAttributeDescriptions(VertexPosition::stream(), VertexAttributes::stream()),
+    };
+  }
+
+  return {
+    vertexBindingDescriptions(PackedPosition::stream(format), PackedAttributes::stream(format)),
+    vertexAttributeDescriptions(PackedPosition::stream(format), PackedAttributes::stream(format)),
+  };
+}
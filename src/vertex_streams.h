@@ -0,0 +1,44 @@
+#pragma once
+
+#include "vertex.h"
+#include "vertex_quantization.h"
+
+#include <array>
+#include <vector>
+
+// Vertex data as it is uploaded: binding 0 holds tightly packed positions,
+// binding 1 everything else.
+struct VertexStreams {
+  std::vector<char> positions;
+  std::vector<char> attributes;
+};
+
+VertexStreams splitVertexStreams(const Vertex* vertices, size_t vertexCount);
+VertexStreams splitVertexStreams(const std::vector<PackedVertex>& vertices);
+
+// Vertices in the form they are uploaded for one VertexFormat: quantized
+// unless it is Float32, and split into streams.
+struct UploadVertices {
+  VertexFormat format = VertexFormat::Float32;
+  VertexDequantization dequantization{}; // unused for Float32
+  uint64_t vertexCount = 0;
+  VertexStreams streams;
+};
+
+// Quantizes and splits vertices for format. error, when given, is set to how
+// far the packed vertices are from the originals; Float32 leaves it alone.
+UploadVertices prepareUploadVertices(
+  const Vertex* vertices,
+  size_t vertexCount,
+  VertexFormat format,
+  QuantizationError* error = nullptr);
+
+// Pipeline vertex input for the split streams. The position binding and its
+// attribute come first, so a pipeline that only needs positions uses just
+// the first element of each array.
+struct VertexInputLayout {
+  std::array<VkVertexInputBindingDescription, 2> bindings;
+  std::array<VkVertexInputAttributeDescription, 3> attributes;
+};
+
+VertexInputLayout vertexInputLayout(VertexFormat format);